@@ -2,6 +2,7 @@
 //  SPDX-License-Identifier: Unlicense
 
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
@@ -9,6 +10,13 @@
 #include <stdio.h>
 #include <assert.h>
 #include <threads.h>
+#include <ctype.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -22,12 +30,23 @@ extern "C" {
 #endif
 #endif
 
+// This file also gets built as C++ (e.g. by Verilator), which spells it differently.
+#ifdef __cplusplus
+#define RV_STATIC_ASSERT(cond, msg) static_assert(cond, msg)
+#else
+#define RV_STATIC_ASSERT(cond, msg) _Static_assert(cond, msg)
+#endif
+// For structs this file repeats from rv_disass.h instead of including it.
+#define RV_LAYOUT(type, field, offset) \
+    RV_STATIC_ASSERT(offsetof(type, field) == (offset), #type "." #field " moved")
+
 // Pseudoinst flags (per InstLayout)
 #define PS_I_NOP  (1 << 0)
 #define PS_I_MV   (1 << 1)
 #define PS_I_NOT  (1 << 2)
 #define PS_I_SEXT (1 << 3)
 #define PS_I_SEQZ (1 << 4)
+#define PS_I_LI   (1 << 5)
 
 #define PS_R_NEG  (1 << 0)
 #define PS_R_NEGW (1 << 1)
@@ -96,11 +115,14 @@ typedef struct {
                           // When this is enabled, strings are free'd during the next
                           // disass call.
     bool  SimDoesFree;    // Whether simulator does the free'ing.
+    bool  LlvmStyle;      // Match LLVM's MC output byte-for-byte: tab before the
+                          // mnemonic and between mnemonic and operands.
 } Context;
 Context g_context = {
     false,
     false,
     true,
+    false,
     false
 };
 
@@ -133,6 +155,9 @@ typedef struct {
 } OpInfo;
 DPI_DLLESPEC extern const OpInfo UncompressedInsts[];
 DPI_DLLESPEC extern const uint32_t UncompressedInstsSize;
+DPI_DLLESPEC const OpInfo* rv_find_op(uint32_t inst);
+DPI_DLLESPEC const OpInfo* rv_find_op_linear(uint32_t inst);
+DPI_DLLESPEC int rv_opcode_id(unsigned int inst);
 // End test interface
 
 DPI_DLLESPEC const OpInfo UncompressedInsts[] = {
@@ -156,7 +181,7 @@ DPI_DLLESPEC const OpInfo UncompressedInsts[] = {
     {"sb",    ENC_F3(0b000) | ENC_OP(0b0100011), MASK_F3 | MASK_OP, InstLayout_S, 0},
     {"sh",    ENC_F3(0b001) | ENC_OP(0b0100011), MASK_F3 | MASK_OP, InstLayout_S, 0},
     {"sw",    ENC_F3(0b010) | ENC_OP(0b0100011), MASK_F3 | MASK_OP, InstLayout_S, 0},
-    {"addi",  ENC_F3(0b000) | ENC_OP(0b0010011), MASK_F3 | MASK_OP, InstLayout_I, PS_I_NOP | PS_I_MV},
+    {"addi",  ENC_F3(0b000) | ENC_OP(0b0010011), MASK_F3 | MASK_OP, InstLayout_I, PS_I_NOP | PS_I_LI | PS_I_MV},
     {"slti",  ENC_F3(0b010) | ENC_OP(0b0010011), MASK_F3 | MASK_OP, InstLayout_I, 0},
     {"sltiu", ENC_F3(0b011) | ENC_OP(0b0010011), MASK_F3 | MASK_OP, InstLayout_I, PS_I_SEQZ},
     {"xori",  ENC_F3(0b100) | ENC_OP(0b0010011), MASK_F3 | MASK_OP, InstLayout_I, PS_I_NOT},
@@ -203,7 +228,144 @@ DPI_DLLESPEC const OpInfo UncompressedInsts[] = {
     {"csrrci",                    ENC_F3(0b111) | ENC_OP(0b1110011),           MASK_F3 | MASK_OP, InstLayout_CsrImm, 0},
 };
 
-DPI_DLLESPEC const uint32_t UncompressedInstsSize = sizeof(UncompressedInsts)/sizeof(UncompressedInsts[0]);
+#define UNCOMPRESSED_INSTS_COUNT (sizeof(UncompressedInsts)/sizeof(UncompressedInsts[0]))
+DPI_DLLESPEC const uint32_t UncompressedInstsSize = UNCOMPRESSED_INSTS_COUNT;
+
+// Reference decoder: the first table entry whose value/mask pair matches.
+// Everything derived from the table gets checked against this one.
+DPI_DLLESPEC const OpInfo* rv_find_op_linear(uint32_t inst) {
+    for (uint32_t i = 0; i < UncompressedInstsSize; i++) {
+        const OpInfo* info = &UncompressedInsts[i];
+        if ((inst & info->searchMask) == info->searchVal) {
+            return info;
+        }
+    }
+    return NULL;
+}
+
+// Derived decoder: table entries bucketed by major opcode (inst[6:0]), so a
+// lookup only walks the handful of entries sharing an opcode. Buckets keep
+// table order, so the result is always the same as rv_find_op_linear.
+#define OP_BUCKETS (MASK_OP + 1)
+static uint16_t s_opBucketStart[OP_BUCKETS + 1];
+static uint8_t  s_opBucketIdx[OP_BUCKETS * UNCOMPRESSED_INSTS_COUNT];
+RV_STATIC_ASSERT(UNCOMPRESSED_INSTS_COUNT <= 256, "s_opBucketIdx holds table indices in a uint8_t");
+static once_flag s_opBucketsOnce = ONCE_FLAG_INIT;
+
+static void build_op_buckets(void) {
+    uint32_t used = 0;
+    for (uint32_t op = 0; op < OP_BUCKETS; op++) {
+        s_opBucketStart[op] = used;
+        for (uint32_t i = 0; i < UncompressedInstsSize; i++) {
+            const OpInfo* info = &UncompressedInsts[i];
+            if (((op ^ info->searchVal) & info->searchMask & MASK_OP) == 0) {
+                s_opBucketIdx[used++] = i;
+            }
+        }
+    }
+    s_opBucketStart[OP_BUCKETS] = used;
+}
+
+DPI_DLLESPEC const OpInfo* rv_find_op(uint32_t inst) {
+    call_once(&s_opBucketsOnce, build_op_buckets);
+
+    uint32_t op = DEC_OP(inst);
+    for (uint32_t i = s_opBucketStart[op]; i < s_opBucketStart[op + 1]; i++) {
+        const OpInfo* info = &UncompressedInsts[s_opBucketIdx[i]];
+        if ((inst & info->searchMask) == info->searchVal) {
+            return info;
+        }
+    }
+    return NULL;
+}
+
+// Stable per-mnemonic ID (index into UncompressedInsts), or -1 if unknown.
+// Cheaper than matching on the text when all you want is the opcode.
+DPI_DLLESPEC int rv_opcode_id(unsigned int inst) {
+    const OpInfo* info = rv_find_op(inst);
+    return (info != NULL) ? (int)(info - UncompressedInsts) : -1;
+}
+
+static const OpInfo* rv_find_op_by_name(const char* name, size_t len) {
+    for (uint32_t i = 0; i < UncompressedInstsSize; i++) {
+        if (strlen(UncompressedInsts[i].name) == len && strncmp(UncompressedInsts[i].name, name, len) == 0) {
+            return &UncompressedInsts[i];
+        }
+    }
+    return NULL;
+}
+
+// Opcode ID for a mnemonic ("jalr"), or -1 if there's no such inst.
+DPI_DLLESPEC int rv_opcode_id_by_name(const char* name) {
+    const OpInfo* info = rv_find_op_by_name(name, strlen(name));
+    return (info != NULL) ? (int)(info - UncompressedInsts) : -1;
+}
+
+// Size of the opcode ID space: IDs run from 0 to this minus one.
+DPI_DLLESPEC int rv_opcode_count() {
+    return (int)UncompressedInstsSize;
+}
+
+// Mnemonic for an opcode ID, or "unknown" if there's no such ID.
+DPI_DLLESPEC const char* rv_opcode_name(int id) {
+    return (id >= 0 && (uint32_t)id < UncompressedInstsSize) ? UncompressedInsts[id].name : "unknown";
+}
+
+// The words an opcode ID decodes from: (inst & *mask) == *match. Returns 0,
+// or -1 if there's no such ID.
+DPI_DLLESPEC int rv_opcode_pattern(int id, unsigned int* match, unsigned int* mask) {
+    if (id < 0 || (uint32_t)id >= UncompressedInstsSize) {
+        return -1;
+    }
+    *match = UncompressedInsts[id].searchVal;
+    *mask = UncompressedInsts[id].searchMask;
+    return 0;
+}
+
+// Register and CSR numbers an inst actually uses, per its layout; -1 for
+// fields it doesn't have (an immediate in the rs1 slot isn't a register).
+// Returns the opcode ID, with everything -1 for unknown insts.
+DPI_DLLESPEC int rv_decode_fields(unsigned int inst, int* rd, int* rs1, int* rs2, int* csr) {
+    const OpInfo* info = rv_find_op(inst);
+    *rd = *rs1 = *rs2 = *csr = -1;
+    if (info == NULL) {
+        return -1;
+    }
+    switch (info->layout) {
+        case InstLayout_R:
+            *rs2 = (int)DEC_RS2(inst);
+            // fall through
+        case InstLayout_R_shamt5:
+        case InstLayout_R_shamt6:
+        case InstLayout_I:
+        case InstLayout_I_jump:
+        case InstLayout_I_load:
+        case InstLayout_I_shift:
+            *rd = (int)DEC_RD(inst);
+            *rs1 = (int)DEC_RS1(inst);
+            break;
+        case InstLayout_S:
+        case InstLayout_B:
+            *rs1 = (int)DEC_RS1(inst);
+            *rs2 = (int)DEC_RS2(inst);
+            break;
+        case InstLayout_U:
+        case InstLayout_J:
+            *rd = (int)DEC_RD(inst);
+            break;
+        case InstLayout_Csr:
+            *rs1 = (int)DEC_RS1(inst);
+            // fall through
+        case InstLayout_CsrImm:
+            *rd = (int)DEC_RD(inst);
+            *csr = (int)DEC_I12(inst);
+            break;
+        case InstLayout_I_fence:
+        case InstLayout_None:
+            break;
+    }
+    return (int)(info - UncompressedInsts);
+}
 
 typedef struct {
     uint16_t    offset;
@@ -223,27 +385,46 @@ const CsrInfo CsrInfos[] = {
 };
 DPI_DLLESPEC const uint32_t CsrInfosSize = sizeof(CsrInfos)/sizeof(CsrInfos[0]);
 
+static const char* const NumericRegNames[] = {
+   "zero",  "x1",  "x2",  "x3",  "x4",  "x5",  "x6",  "x7",  "x8",  "x9",
+    "x10", "x11", "x12", "x13", "x14", "x15", "x16", "x17", "x18", "x19",
+    "x20", "x21", "x22", "x23", "x24", "x25", "x26", "x27", "x28", "x29",
+    "x30", "x31"
+};
+
+static const char* const AbiRegNames[] = {
+    "zero", "ra", "sp", "gp", "tp", "t0",  "t1",  "t2", "s0", "s1",
+    "a0", "a1", "a2", "a3", "a4", "a5",  "a6",  "a7", "s2", "s3",
+    "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11", "t3", "t4",
+    "t5", "t6"
+};
+// s0 = fp?
+
 static const char* get_abi_name(uint8_t reg) {
-    if (g_context.NoAbiNames) {
-        const char* RegNames[] = {
-           "zero",  "x1",  "x2",  "x3",  "x4",  "x5",  "x6",  "x7",  "x8",  "x9",
-            "x10", "x11", "x12", "x13", "x14", "x15", "x16", "x17", "x18", "x19",
-            "x20", "x21", "x22", "x23", "x24", "x25", "x26", "x27", "x28", "x29",
-            "x30", "x31"
-        };
-
-        return RegNames[reg % 32];
-    } else {
-        const char* RegNames[] = {
-            "zero", "ra", "sp", "gp", "tp", "t0",  "t1",  "t2", "s0", "s1",
-            "a0", "a1", "a2", "a3", "a4", "a5",  "a6",  "a7", "s2", "s3",
-            "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11", "t3", "t4",
-            "t5", "t6"
-        };
-        // s0 = fp?
+    return g_context.NoAbiNames ? NumericRegNames[reg % 32] : AbiRegNames[reg % 32];
+}
+
+// Register name (of reg % 32) as the disassembly currently prints it.
+DPI_DLLESPEC const char* rv_reg_name(unsigned int reg) {
+    return get_abi_name((uint8_t)(reg % 32));
+}
 
-        return RegNames[reg % 32];
+// Register number for "a0", "x10", "fp"..., whatever the options; -1 if none.
+DPI_DLLESPEC int rv_reg_by_name(const char* name) {
+    if (name[0] == 'x' && name[1] != 0) {
+        char* end = NULL;
+        long num = strtol(name + 1, &end, 10);
+        return (*end == 0 && num >= 0 && num < 32) ? (int)num : -1;
+    }
+    if (strcmp(name, "fp") == 0) {
+        return 8;
+    }
+    for (int i = 0; i < 32; i++) {
+        if (strcmp(name, AbiRegNames[i]) == 0) {
+            return i;
+        }
     }
+    return -1;
 }
 
 static char* mprintf(const char* fmt, ...) {
@@ -267,44 +448,215 @@ static char* mprintf(const char* fmt, ...) {
     return outstr;
 }
 
-#define rv_fmt_const(name) strdup((name))
-#define rv_fmt_i(inst, imm)              mprintf("%-7s %d",           (inst), (int32_t)(imm))
-#define rv_fmt_r(inst, r1)               mprintf("%-7s %s",           (inst), get_abi_name((r1)))
-#define rv_fmt_r_i(inst, r1, imm)        mprintf("%-7s %s, %d",       (inst), get_abi_name((r1)), (int32_t)(imm))
-#define rv_fmt_r_r(inst, r1, r2)         mprintf("%-7s %s, %s",       (inst), get_abi_name((r1)), get_abi_name((r2)))
-#define rv_fmt_r_r_i(inst, r1, r2, imm)  mprintf("%-7s %s, %s, %d",   (inst), get_abi_name((r1)), get_abi_name((r2)), (int32_t)(imm))
-#define rv_fmt_r_r_r(inst, r1, r2, r3)   mprintf("%-7s %s, %s, %s",   (inst), get_abi_name((r1)), get_abi_name((r2)), get_abi_name((r3)))
-#define rv_fmt_ir(inst, immr1, r1)       mprintf("%-7s %d(%s)",       (inst), (immr1), get_abi_name((r1)))
-#define rv_fmt_r_ir(inst, r1, immr2, r2) mprintf("%-7s %s, %d(%s)",   (inst), get_abi_name((r1)), (immr2), get_abi_name((r2)))
-#define rv_fmt_r_s_r(inst, r1, s, r2)    mprintf("%-7s %s, %s, %s",   (inst), get_abi_name((r1)), (s), get_abi_name((r2)))
-#define rv_fmt_r_h_r(inst, r1, h, r2)    mprintf("%-7s %s, 0x%x, %s", (inst), get_abi_name((r1)), (h), get_abi_name((r2)))
-#define rv_fmt_r_s_i(inst, r1, s, imm)   mprintf("%-7s %s, %s, %d",   (inst), get_abi_name((r1)), (s), (imm))
-#define rv_fmt_r_h_i(inst, r1, h, imm)   mprintf("%-7s %s, 0x%x, %d", (inst), get_abi_name((r1)), (h), (imm))
+// Mnemonic plus the separator before its operands, in the selected style.
+// Only valid until the next call on this thread.
+static const char* rv_mnem(const char* name) {
+    static thread_local char buf[24];
+    snprintf(buf, sizeof(buf), g_context.LlvmStyle ? "\t%s\t" : "%-7s ", name);
+    return buf;
+}
+
+#define rv_fmt_unknown() strdup("unknown")
+#define rv_fmt_const(name) (g_context.LlvmStyle ? mprintf("\t%s", (name)) : strdup((name)))
+// Real (non-alias) insts without operands; LLVM still prints the separator.
+#define rv_fmt_noargs(name) (g_context.LlvmStyle ? mprintf("\t%s\t", (name)) : strdup((name)))
+#define rv_fmt_i(inst, imm)              mprintf("%s%d",           rv_mnem((inst)), (int32_t)(imm))
+#define rv_fmt_r(inst, r1)               mprintf("%s%s",           rv_mnem((inst)), get_abi_name((r1)))
+#define rv_fmt_r_i(inst, r1, imm)        mprintf("%s%s, %d",       rv_mnem((inst)), get_abi_name((r1)), (int32_t)(imm))
+#define rv_fmt_r_r(inst, r1, r2)         mprintf("%s%s, %s",       rv_mnem((inst)), get_abi_name((r1)), get_abi_name((r2)))
+#define rv_fmt_r_r_i(inst, r1, r2, imm)  mprintf("%s%s, %s, %d",   rv_mnem((inst)), get_abi_name((r1)), get_abi_name((r2)), (int32_t)(imm))
+#define rv_fmt_r_r_r(inst, r1, r2, r3)   mprintf("%s%s, %s, %s",   rv_mnem((inst)), get_abi_name((r1)), get_abi_name((r2)), get_abi_name((r3)))
+#define rv_fmt_ir(inst, immr1, r1)       mprintf("%s%d(%s)",       rv_mnem((inst)), (immr1), get_abi_name((r1)))
+#define rv_fmt_r_ir(inst, r1, immr2, r2) mprintf("%s%s, %d(%s)",   rv_mnem((inst)), get_abi_name((r1)), (immr2), get_abi_name((r2)))
+#define rv_fmt_r_s_r(inst, r1, s, r2)    mprintf("%s%s, %s, %s",   rv_mnem((inst)), get_abi_name((r1)), (s), get_abi_name((r2)))
+#define rv_fmt_r_h_r(inst, r1, h, r2)    mprintf("%s%s, 0x%x, %s", rv_mnem((inst)), get_abi_name((r1)), (h), get_abi_name((r2)))
+#define rv_fmt_r_s_i(inst, r1, s, imm)   mprintf("%s%s, %s, %d",   rv_mnem((inst)), get_abi_name((r1)), (s), (imm))
+#define rv_fmt_r_h_i(inst, r1, h, imm)   mprintf("%s%s, 0x%x, %d", rv_mnem((inst)), get_abi_name((r1)), (h), (imm))
+
+// Immediate decoding, shared by the formatters and coverage.
+static uint32_t rv_imm_i(uint32_t inst) {
+    // Do sign extension of immediate
+    return DEC_I12(inst) | MAKE_SEXT_BITS(inst, 12);
+}
+
+static uint32_t rv_imm_s(uint32_t inst) {
+    return MAKE_SEXT_BITS(inst, 12) | (DEC_F7(inst) << 5) | DEC_RD(inst);
+}
+
+static uint32_t rv_imm_b(uint32_t inst) {
+    // Throw these bits at a dartboard and see where they land....
+    // Exactly what are they smoking at Berkeley?
+    uint32_t imm = 0;
+    imm |= (inst & 0x80) << 4;
+    imm |= (inst & 0xF00) >> 7;
+    imm |= (inst & 0x7E000000) >> 20;
+    imm |= MAKE_SEXT_BITS(inst, 13);
+    return imm;
+}
+
+static uint32_t rv_imm_j(uint32_t inst) {
+    uint32_t raw_imm = DEC_I20(inst);
+
+    // The next major rev of riscv should put an lfsr here because clearly this isn't convoluted enough.
+    uint32_t imm = 0;
+    imm |= (raw_imm & 0xFF) << 12;
+    imm |= ((raw_imm >> 8) & 0x1) << 11;
+    imm |= ((raw_imm >> 9) & 0x3FF) << 1;
+    imm |= ((raw_imm >> 19) & 0x1) << 20;
+    imm |= MAKE_SEXT_BITS(inst, 21);
+    return imm;
+}
+
+// Which pseudo-instruction (if any) an inst can be written as. This is the
+// one place the pseudo rules live; formatting and coverage both go by it.
+typedef enum {
+    PseudoForm_None,
+    PseudoForm_Nop,
+    PseudoForm_Li,
+    PseudoForm_Mv,
+    PseudoForm_Not,
+    PseudoForm_SextW,
+    PseudoForm_Seqz,
+    PseudoForm_Ret,
+    PseudoForm_Jr,
+    PseudoForm_JrOffset,
+    PseudoForm_JalrRa,
+    PseudoForm_JalrRaOffset,
+    PseudoForm_JalrNoOffset,
+    PseudoForm_Fence,
+    PseudoForm_FenceTso,
+    PseudoForm_Blez,
+    PseudoForm_BranchZ,
+    PseudoForm_Bgtz,
+    PseudoForm_Neg,
+    PseudoForm_Negw,
+    PseudoForm_Snez,
+    PseudoForm_Sltz,
+    PseudoForm_Sgtz,
+    PseudoForm_J,
+    PseudoForm_JalRa,
+    PseudoForm_Count,
+} PseudoForm;
+
+static PseudoForm rv_pseudo_form(uint32_t inst, const OpInfo* info) {
+    uint32_t flags = info->pseudoInstFlags;
+    uint32_t rd  = DEC_RD(inst);
+    uint32_t rs1 = DEC_RS1(inst);
+    uint32_t rs2 = DEC_RS2(inst);
+
+    switch (info->layout) {
+        case InstLayout_I: {
+            uint32_t imm = rv_imm_i(inst);
+            if ((flags & PS_I_NOP) && (rd == 0) && (rs1 == 0) && (imm == 0)) {
+                return PseudoForm_Nop;
+            }
+            if ((flags & PS_I_LI) && (rs1 == 0)) {
+                return PseudoForm_Li;
+            }
+            if ((flags & PS_I_MV) && (imm == 0)) {
+                return PseudoForm_Mv;
+            }
+            if ((flags & PS_I_NOT) && (imm == (uint32_t)-1)) {
+                return PseudoForm_Not;
+            }
+            if ((flags & PS_I_SEXT) && (imm == 0)) {
+                return PseudoForm_SextW;
+            }
+            if ((flags & PS_I_SEQZ) && (imm == 1)) {
+                return PseudoForm_Seqz;
+            }
+            break;
+        }
+        case InstLayout_I_jump: {
+            uint32_t imm = rv_imm_i(inst);
+            if (rd == 0 && imm == 0 && rs1 == 1) {
+                return PseudoForm_Ret;
+            } else if (rd == 0 && imm == 0) {
+                return PseudoForm_Jr;
+            } else if (rd == 0) {
+                return PseudoForm_JrOffset;
+            } else if (rd == 1 && imm == 0) {
+                return PseudoForm_JalrRa;
+            } else if (rd == 1) {
+                return PseudoForm_JalrRaOffset;
+            } else if (imm == 0) {
+                return PseudoForm_JalrNoOffset;
+            }
+            break;
+        }
+        case InstLayout_I_fence:
+            if (inst == 0x0ff0000f) {
+                return PseudoForm_Fence;
+            }
+            if (inst == 0x8330000f) {
+                return PseudoForm_FenceTso;
+            }
+            break;
+        case InstLayout_B:
+            if ((flags & PS_B_BLEZ) && rs1 == 0) {
+                return PseudoForm_Blez;
+            }
+            if ((flags & PS_B_ANY_Z) && rs2 == 0) {
+                return PseudoForm_BranchZ;
+            }
+            if ((flags & PS_B_BGTZ) && rs1 == 0) {
+                return PseudoForm_Bgtz;
+            }
+            break;
+        case InstLayout_R:
+            if ((flags & PS_R_NEG) && rs1 == 0) {
+                return PseudoForm_Neg;
+            }
+            if ((flags & PS_R_NEGW) && rs1 == 0) {
+                return PseudoForm_Negw;
+            }
+            if ((flags & PS_R_SNEZ) && rs1 == 0) {
+                return PseudoForm_Snez;
+            }
+            if ((flags & PS_R_SLTZ) && rs2 == 0) {
+                return PseudoForm_Sltz;
+            }
+            if ((flags & PS_R_SGTZ) && rs1 == 0) {
+                return PseudoForm_Sgtz;
+            }
+            break;
+        case InstLayout_J:
+            if (rd == 0) {
+                return PseudoForm_J;
+            } else if (rd == 1) {
+                return PseudoForm_JalRa;
+            }
+            break;
+        default:
+            break;
+    }
+    return PseudoForm_None;
+}
+
+static PseudoForm rv_pseudo_form_if_enabled(uint32_t inst, const OpInfo* info) {
+    return g_context.UsePseudoInsts ? rv_pseudo_form(inst, info) : PseudoForm_None;
+}
 
 static char* rv_disass_i(unsigned int inst, const OpInfo* info) {
     uint32_t rd = DEC_RD(inst);
     uint32_t rs1 = DEC_RS1(inst);
-    uint32_t imm = DEC_I12(inst);
+    uint32_t imm = rv_imm_i(inst);
 
-    // Do sign extension of immediate
-    imm |= MAKE_SEXT_BITS(inst, 12);
-
-    if (g_context.UsePseudoInsts && info->pseudoInstFlags) {
-        if ((info->pseudoInstFlags & PS_I_NOP) && (rd == 0) && (rs1 == 0) && (imm == 0)) {
+    switch (rv_pseudo_form_if_enabled(inst, info)) {
+        case PseudoForm_Nop:
             return rv_fmt_const("nop");
-        }
-        if ((info->pseudoInstFlags & PS_I_MV) && (imm == 0)) {
+        case PseudoForm_Li:
+            return rv_fmt_r_i("li", rd, imm);
+        case PseudoForm_Mv:
             return rv_fmt_r_r("mv", rd, rs1);
-        }
-        if ((info->pseudoInstFlags & PS_I_NOT) && (imm == (uint32_t)-1)) {
+        case PseudoForm_Not:
             return rv_fmt_r_r("not", rd, rs1);
-        }
-        if ((info->pseudoInstFlags & PS_I_SEXT) && (imm == 0)) {
+        case PseudoForm_SextW:
             return rv_fmt_r_r("sext.w", rd, rs1);
-        }
-        if ((info->pseudoInstFlags & PS_I_SEQZ) && (imm == 1)) {
+        case PseudoForm_Seqz:
             return rv_fmt_r_r("seqz", rd, rs1);
-        }
+        default:
+            break;
     }
 
     return rv_fmt_r_r_i(info->name, rd, rs1, imm);
@@ -321,25 +673,23 @@ static char* rv_disass_i_shift(unsigned int inst, const OpInfo* info) {
 static char* rv_disass_i_jump(unsigned int inst, const OpInfo* info) {
     uint32_t rd = DEC_RD(inst);
     uint32_t rs1 = DEC_RS1(inst);
-    uint32_t imm = DEC_I12(inst);
-
-    // Do sign extension of immediate
-    imm |= MAKE_SEXT_BITS(inst, 12);
+    uint32_t imm = rv_imm_i(inst);
 
-    if (g_context.UsePseudoInsts) {
-        if (rd == 0 && imm == 0 && rs1 == 1) {
+    switch (rv_pseudo_form_if_enabled(inst, info)) {
+        case PseudoForm_Ret:
             return rv_fmt_const("ret");
-        } else if (rd == 0 && imm == 0) {
+        case PseudoForm_Jr:
             return rv_fmt_r("jr", rs1);
-        } else if (rd == 0) {
+        case PseudoForm_JrOffset:
             return rv_fmt_ir("jr", imm, rs1);
-        } else if (rd == 1 && imm == 0) {
+        case PseudoForm_JalrRa:
             return rv_fmt_r(info->name, rs1);
-        } else if (rd == 1) {
+        case PseudoForm_JalrRaOffset:
             return rv_fmt_ir(info->name, imm, rs1);
-        } else if (imm == 0) {
+        case PseudoForm_JalrNoOffset:
             return rv_fmt_r_r(info->name, rd, rs1);
-        }
+        default:
+            break;
     }
 
     return rv_fmt_r_ir(info->name, rd, imm, rs1);
@@ -348,10 +698,7 @@ static char* rv_disass_i_jump(unsigned int inst, const OpInfo* info) {
 static char* rv_disass_i_load(unsigned int inst, const OpInfo* info) {
     uint32_t rd = DEC_RD(inst);
     uint32_t rs1 = DEC_RS1(inst);
-    uint32_t imm = DEC_I12(inst);
-
-    // Do sign extension of immediate
-    imm |= MAKE_SEXT_BITS(inst, 12);
+    uint32_t imm = rv_imm_i(inst);
 
     return rv_fmt_r_ir(info->name, rd, imm, rs1);
 }
@@ -361,20 +708,21 @@ static char* rv_disass_i_fence(unsigned int inst, const OpInfo* info) {
     uint32_t rs1 = DEC_RS1(inst);
     uint32_t fm = DEC_FM(inst);
 
-    if (g_context.UsePseudoInsts && inst == 0x0ff0000f) {
-        return rv_fmt_const("fence");
+    switch (rv_pseudo_form_if_enabled(inst, info)) {
+        case PseudoForm_Fence:
+            return rv_fmt_const("fence");
+        case PseudoForm_FenceTso:
+            return rv_fmt_noargs("fence.tso");
+        default:
+            break;
     }
     if (inst == 0x8330000f) {
-        if (g_context.UsePseudoInsts) {
-            return rv_fmt_const("fence.tso");
-        } else {
-            return rv_fmt_const("fence.tso rw, rw");
-        }
+        return mprintf("%srw, rw", rv_mnem("fence.tso"));
     }
 
     // These are reserved insts.
     if (rd != 0 || rs1 != 0 || fm != 0) {
-        return rv_fmt_const("unknown");
+        return rv_fmt_unknown();
     }
     const char* bitnames = "iorw";
 
@@ -397,7 +745,7 @@ static char* rv_disass_i_fence(unsigned int inst, const OpInfo* info) {
     const char* predstr = (predbuf[0] != 0) ? predbuf : "unknown";
     const char* sucstr = (sucbuf[0] != 0) ? sucbuf : "unknown";
 
-    return mprintf("%-7s %s, %s", info->name, predstr, sucstr);
+    return mprintf("%s%s, %s", rv_mnem(info->name), predstr, sucstr);
 }
 
 static char* rv_disass_u(unsigned int inst, const OpInfo* info) {
@@ -410,28 +758,21 @@ static char* rv_disass_u(unsigned int inst, const OpInfo* info) {
 static char* rv_disass_b(unsigned int inst, const OpInfo* info) {
     uint32_t rs1 = DEC_RS1(inst);
     uint32_t rs2 = DEC_RS2(inst);
+    uint32_t imm = rv_imm_b(inst);
 
-    // Throw these bits at a dartboard and see where they land....
-    // Exactly what are they smoking at Berkeley?
-    uint32_t imm = 0;
-    imm |= (inst & 0x80) << 4;
-    imm |= (inst & 0xF00) >> 7;
-    imm |= (inst & 0x7E000000) >> 20;
-    imm |= MAKE_SEXT_BITS(inst, 13);
-
-    if (g_context.UsePseudoInsts) {
-        if (info->pseudoInstFlags & PS_B_BLEZ && rs1 == 0) {
+    switch (rv_pseudo_form_if_enabled(inst, info)) {
+        case PseudoForm_Blez:
             return rv_fmt_r_i("blez", rs2, imm);
-        }
-        if (info->pseudoInstFlags & PS_B_ANY_Z && rs2 == 0) {
+        case PseudoForm_BranchZ: {
             char newinst[8] = {0};
             strcpy(newinst, info->name);
             strcat(newinst, "z");
             return rv_fmt_r_i(newinst, rs1, imm);
         }
-        if (info->pseudoInstFlags & PS_B_BGTZ && rs1 == 0) {
+        case PseudoForm_Bgtz:
             return rv_fmt_r_i("bgtz", rs2, imm);
-        }
+        default:
+            break;
     }
 
     return rv_fmt_r_r_i(info->name, rs1, rs2, imm);
@@ -442,24 +783,19 @@ static char* rv_disass_r(unsigned int inst, const OpInfo* info) {
     uint32_t rs1 = DEC_RS1(inst);
     uint32_t rs2 = DEC_RS2(inst);
 
-    if (g_context.UsePseudoInsts && info->pseudoInstFlags)
-    {
-        if (info->pseudoInstFlags & PS_R_NEG && rs1 == 0) {
+    switch (rv_pseudo_form_if_enabled(inst, info)) {
+        case PseudoForm_Neg:
             return rv_fmt_r_r("neg", rd, rs2);
-        }
-        if (info->pseudoInstFlags & PS_R_NEGW && rs1 == 0) {
+        case PseudoForm_Negw:
             return rv_fmt_r_r("negw", rd, rs2);
-        }
-        if (info->pseudoInstFlags & PS_R_SNEZ && rs1 == 0) {
+        case PseudoForm_Snez:
             return rv_fmt_r_r("snez", rd, rs2);
-        }
-        if (info->pseudoInstFlags & PS_R_SLTZ && rs2 == 0) {
+        case PseudoForm_Sltz:
             return rv_fmt_r_r("sltz", rd, rs1);
-        }
-        if (info->pseudoInstFlags & PS_R_SGTZ && rs1 == 0) {
+        case PseudoForm_Sgtz:
             return rv_fmt_r_r("sgtz", rd, rs2);
-        }
-
+        default:
+            break;
     }
 
     return rv_fmt_r_r_r(info->name, rd, rs1, rs2);
@@ -495,7 +831,7 @@ static char* rv_disass_csr(unsigned int inst, const OpInfo* info) {
 }
 
 static char* rv_disass_s(unsigned int inst, const OpInfo* info) {
-    uint32_t imm = MAKE_SEXT_BITS(inst, 12) | (DEC_F7(inst) << 5) | DEC_RD(inst);
+    uint32_t imm = rv_imm_s(inst);
     uint32_t rs1 = DEC_RS1(inst);
     uint32_t rs2 = DEC_RS2(inst);
 
@@ -504,71 +840,59 @@ static char* rv_disass_s(unsigned int inst, const OpInfo* info) {
 
 static char* rv_disass_j(unsigned int inst, const OpInfo* info) {
     uint32_t rd  = DEC_RD(inst);
-    uint32_t raw_imm = DEC_I20(inst);
-
-    // The next major rev of riscv should put an lfsr here because clearly this isn't convoluted enough.
-    uint32_t imm = 0;
-    imm |= (raw_imm & 0xFF) << 12;
-    imm |= ((raw_imm >> 8) & 0x1) << 11;
-    imm |= ((raw_imm >> 9) & 0x3FF) << 1;
-    imm |= ((raw_imm >> 19) & 0x1) << 20;
-    imm |= MAKE_SEXT_BITS(inst, 21);
+    uint32_t imm = rv_imm_j(inst);
 
-    if (g_context.UsePseudoInsts) {
-        if (rd == 0) {
+    switch (rv_pseudo_form_if_enabled(inst, info)) {
+        case PseudoForm_J:
             return rv_fmt_i("j", imm);
-        } else if (rd == 1) {
+        case PseudoForm_JalRa:
             return rv_fmt_i("jal", imm);
-        }
+        default:
+            break;
     }
     return rv_fmt_r_i(info->name, rd, imm);
 }
 
 static char* rv_disass_none(unsigned int _dummy, const OpInfo* info) {
     (void)_dummy;
-    return rv_fmt_const(info->name);
+    return rv_fmt_noargs(info->name);
 }
 
 static char* rv_disass_impl(unsigned int inst) {
-    // Start with a naive search
-    // We can choose better algorithms (bsearch, jump table) later.
-    for (uint32_t i = 0; i < UncompressedInstsSize; i++) {
-        const OpInfo* info = &UncompressedInsts[i];
-        if ((inst & info->searchMask) == info->searchVal) {
-            switch (info->layout) {
-                case InstLayout_B:
-                    return rv_disass_b(inst, info);
-                case InstLayout_I:
-                    return rv_disass_i(inst, info);
-                case InstLayout_I_jump:
-                    return rv_disass_i_jump(inst, info);
-                case InstLayout_I_load:
-                    return rv_disass_i_load(inst, info);
-                case InstLayout_I_shift:
-                    return rv_disass_i_shift(inst, info);
-                case InstLayout_I_fence:
-                    return rv_disass_i_fence(inst, info);
-                case InstLayout_U:
-                    return rv_disass_u(inst, info);
-                case InstLayout_S:
-                    return rv_disass_s(inst, info);
-                case InstLayout_R:
-                    return rv_disass_r(inst, info);
-                case InstLayout_J:
-                    return rv_disass_j(inst, info);
-                case InstLayout_Csr:
-                case InstLayout_CsrImm:
-                    return rv_disass_csr(inst, info);
-                case InstLayout_None:
-                    return rv_disass_none(inst, info);
-                default:
-                    // not implemented :(
-                    break;
-            }
-            break;
+    const OpInfo* info = rv_find_op(inst);
+    if (info != NULL) {
+        switch (info->layout) {
+            case InstLayout_B:
+                return rv_disass_b(inst, info);
+            case InstLayout_I:
+                return rv_disass_i(inst, info);
+            case InstLayout_I_jump:
+                return rv_disass_i_jump(inst, info);
+            case InstLayout_I_load:
+                return rv_disass_i_load(inst, info);
+            case InstLayout_I_shift:
+                return rv_disass_i_shift(inst, info);
+            case InstLayout_I_fence:
+                return rv_disass_i_fence(inst, info);
+            case InstLayout_U:
+                return rv_disass_u(inst, info);
+            case InstLayout_S:
+                return rv_disass_s(inst, info);
+            case InstLayout_R:
+                return rv_disass_r(inst, info);
+            case InstLayout_J:
+                return rv_disass_j(inst, info);
+            case InstLayout_Csr:
+            case InstLayout_CsrImm:
+                return rv_disass_csr(inst, info);
+            case InstLayout_None:
+                return rv_disass_none(inst, info);
+            default:
+                // not implemented :(
+                break;
         }
     }
-    return rv_fmt_const("unknown");
+    return rv_fmt_unknown();
 }
 
 DPI_DLLESPEC const char* rv_disass(int raw_inst) {
@@ -615,6 +939,9 @@ DPI_DLLESPEC void rv_set_option(const char* str, char enabled_in) {
     if (strcmp(str, "SimDoesFree") == 0) {
         g_context.SimDoesFree = enabled;
     }
+    if (strcmp(str, "LlvmStyle") == 0) {
+        g_context.LlvmStyle = enabled;
+    }
 }
 
 DPI_DLLESPEC void rv_reset_options() {
@@ -622,6 +949,1877 @@ DPI_DLLESPEC void rv_reset_options() {
     g_context.SimDoesCopy = true;
 }
 
+// =========================================
+// Compressed instructions
+//
+// There's no separate RVC printer: each 16-bit parcel is expanded to the
+// 32-bit inst it stands for and printed as that, same as LLVM and objdump do
+// by default. Only the RV64C integer subset is covered; the FP loads and
+// stores come back as unknown along with the reserved encodings.
+
+#define RVC_RD(p)     (((p) >> 7) & 0x1F)
+#define RVC_RS2(p)    (((p) >> 2) & 0x1F)
+#define RVC_RDP(p)    ((((p) >> 2) & 0x7) + 8) // rd'/rs2'
+#define RVC_RS1P(p)   ((((p) >> 7) & 0x7) + 8) // rs1'/rd'
+#define RVC_BIT(p, b) (((p) >> (b)) & 1)
+
+static uint32_t rvc_enc_i(uint32_t op, uint32_t f3, uint32_t rd, uint32_t rs1, int32_t imm) {
+    return ENC_OP(op) | (rd << SHIFT_RD) | ENC_F3(f3) | (rs1 << SHIFT_RS1) | ((uint32_t)imm << SHIFT_I12);
+}
+
+static uint32_t rvc_enc_r(uint32_t op, uint32_t f3, uint32_t f7, uint32_t rd, uint32_t rs1, uint32_t rs2) {
+    return ENC_OP(op) | (rd << SHIFT_RD) | ENC_F3(f3) | (rs1 << SHIFT_RS1) | (rs2 << SHIFT_RS2) | ENC_F7(f7);
+}
+
+static uint32_t rvc_enc_s(uint32_t f3, uint32_t rs1, uint32_t rs2, uint32_t imm) {
+    return ENC_OP(0x23) | ((imm & 0x1F) << SHIFT_RD) | ENC_F3(f3) | (rs1 << SHIFT_RS1) | (rs2 << SHIFT_RS2) |
+           ENC_F7(imm >> 5);
+}
+
+static uint32_t rvc_enc_b(uint32_t f3, uint32_t rs1, int32_t imm) {
+    uint32_t u = (uint32_t)imm;
+    return ENC_OP(0x63) | (((u >> 11) & 1) << 7) | (((u >> 1) & 0xF) << 8) | ENC_F3(f3) | (rs1 << SHIFT_RS1) |
+           (((u >> 5) & 0x3F) << 25) | (((u >> 12) & 1) << 31);
+}
+
+static uint32_t rvc_enc_j(uint32_t rd, int32_t imm) {
+    uint32_t u = (uint32_t)imm;
+    return ENC_OP(0x6F) | (rd << SHIFT_RD) | (((u >> 12) & 0xFF) << 12) | (((u >> 11) & 1) << 20) |
+           (((u >> 1) & 0x3FF) << 21) | (((u >> 20) & 1) << 31);
+}
+
+// Sign-extended imm[5]=p[12], imm[4:0]=p[6:2], as used by most of quadrant 1.
+static int32_t rvc_imm6(uint32_t p) {
+    int32_t imm = (int32_t)(((p >> 2) & 0x1F) | (RVC_BIT(p, 12) << 5));
+    return (imm ^ 0x20) - 0x20;
+}
+
+// Returns the 32-bit equivalent of a 16-bit parcel, or 0 if there isn't one.
+static uint32_t rv_expand_compressed(uint32_t p) {
+    uint32_t f3 = (p >> 13) & 0x7;
+    uint32_t rd = RVC_RD(p);
+    uint32_t rs2 = RVC_RS2(p);
+    uint32_t imm;
+    int32_t simm;
+
+    switch (((p & 0x3) << 3) | f3) {
+        // Quadrant 0
+        case 000: // c.addi4spn
+            imm = (((p >> 11) & 0x3) << 4) | (((p >> 7) & 0xF) << 6) | (RVC_BIT(p, 6) << 2) | (RVC_BIT(p, 5) << 3);
+            return imm ? rvc_enc_i(0x13, 0, RVC_RDP(p), 2, (int32_t)imm) : 0;
+        case 002: // c.lw
+            imm = (((p >> 10) & 0x7) << 3) | (RVC_BIT(p, 6) << 2) | (RVC_BIT(p, 5) << 6);
+            return rvc_enc_i(0x03, 2, RVC_RDP(p), RVC_RS1P(p), (int32_t)imm);
+        case 003: // c.ld
+            imm = (((p >> 10) & 0x7) << 3) | (((p >> 5) & 0x3) << 6);
+            return rvc_enc_i(0x03, 3, RVC_RDP(p), RVC_RS1P(p), (int32_t)imm);
+        case 006: // c.sw
+            imm = (((p >> 10) & 0x7) << 3) | (RVC_BIT(p, 6) << 2) | (RVC_BIT(p, 5) << 6);
+            return rvc_enc_s(2, RVC_RS1P(p), RVC_RDP(p), imm);
+        case 007: // c.sd
+            imm = (((p >> 10) & 0x7) << 3) | (((p >> 5) & 0x3) << 6);
+            return rvc_enc_s(3, RVC_RS1P(p), RVC_RDP(p), imm);
+
+        // Quadrant 1
+        case 010: // c.addi, c.nop
+            return rvc_enc_i(0x13, 0, rd, rd, rvc_imm6(p));
+        case 011: // c.addiw
+            return rd ? rvc_enc_i(0x1B, 0, rd, rd, rvc_imm6(p)) : 0;
+        case 012: // c.li
+            return rvc_enc_i(0x13, 0, rd, 0, rvc_imm6(p));
+        case 013:
+            if (rd == 2) { // c.addi16sp
+                simm = (int32_t)((RVC_BIT(p, 6) << 4) | (RVC_BIT(p, 2) << 5) | (RVC_BIT(p, 5) << 6) |
+                                 (((p >> 3) & 0x3) << 7) | (RVC_BIT(p, 12) << 9));
+                simm = (simm ^ 0x200) - 0x200;
+                return simm ? rvc_enc_i(0x13, 0, 2, 2, simm) : 0;
+            }
+            simm = rvc_imm6(p); // c.lui
+            return simm ? ENC_OP(0x37) | (rd << SHIFT_RD) | (((uint32_t)simm & 0xFFFFF) << SHIFT_I20) : 0;
+        case 014:
+            rd = RVC_RS1P(p);
+            switch ((p >> 10) & 0x3) {
+                case 0: // c.srli
+                    return rvc_enc_i(0x13, 5, rd, rd, (int32_t)((p >> 2) & 0x1F) | (int32_t)(RVC_BIT(p, 12) << 5));
+                case 1: // c.srai
+                    return rvc_enc_i(0x13, 5, rd, rd, (int32_t)((p >> 2) & 0x1F) | (int32_t)(RVC_BIT(p, 12) << 5)) |
+                           ENC_F7(0x20);
+                case 2: // c.andi
+                    return rvc_enc_i(0x13, 7, rd, rd, rvc_imm6(p));
+                default: {
+                    static const uint8_t f3s[4] = {0, 4, 6, 7}; // c.sub, c.xor, c.or, c.and
+                    uint32_t sel = (p >> 5) & 0x3;
+                    rs2 = RVC_RDP(p);
+                    if (!RVC_BIT(p, 12)) {
+                        return rvc_enc_r(0x33, f3s[sel], sel ? 0 : 0x20, rd, rd, rs2);
+                    }
+                    if (sel < 2) { // c.subw, c.addw
+                        return rvc_enc_r(0x3B, 0, sel ? 0 : 0x20, rd, rd, rs2);
+                    }
+                    return 0;
+                }
+            }
+        case 015: // c.j
+            simm = (int32_t)((((p >> 3) & 0x7) << 1) | (RVC_BIT(p, 11) << 4) | (RVC_BIT(p, 2) << 5) |
+                             (RVC_BIT(p, 7) << 6) | (RVC_BIT(p, 6) << 7) | (((p >> 9) & 0x3) << 8) |
+                             (RVC_BIT(p, 8) << 10) | (RVC_BIT(p, 12) << 11));
+            return rvc_enc_j(0, (simm ^ 0x800) - 0x800);
+        case 016: // c.beqz
+        case 017: // c.bnez
+            simm = (int32_t)((((p >> 3) & 0x3) << 1) | (((p >> 10) & 0x3) << 3) | (RVC_BIT(p, 2) << 5) |
+                             (((p >> 5) & 0x3) << 6) | (RVC_BIT(p, 12) << 8));
+            return rvc_enc_b(f3 & 1, RVC_RS1P(p), (simm ^ 0x100) - 0x100);
+
+        // Quadrant 2
+        case 020: // c.slli
+            return rvc_enc_i(0x13, 1, rd, rd, (int32_t)((p >> 2) & 0x1F) | (int32_t)(RVC_BIT(p, 12) << 5));
+        case 022: // c.lwsp
+            imm = (((p >> 4) & 0x7) << 2) | (RVC_BIT(p, 12) << 5) | (((p >> 2) & 0x3) << 6);
+            return rd ? rvc_enc_i(0x03, 2, rd, 2, (int32_t)imm) : 0;
+        case 023: // c.ldsp
+            imm = (((p >> 5) & 0x3) << 3) | (RVC_BIT(p, 12) << 5) | (((p >> 2) & 0x7) << 6);
+            return rd ? rvc_enc_i(0x03, 3, rd, 2, (int32_t)imm) : 0;
+        case 024:
+            if (!RVC_BIT(p, 12)) {
+                if (rs2 == 0) { // c.jr
+                    return rd ? rvc_enc_i(0x67, 0, 0, rd, 0) : 0;
+                }
+                return rvc_enc_i(0x13, 0, rd, rs2, 0); // c.mv, as addi like LLVM does so it prints as mv
+            }
+            if (rs2 == 0) { // c.ebreak, c.jalr
+                return rd ? rvc_enc_i(0x67, 0, 1, rd, 0) : 0x00100073;
+            }
+            return rvc_enc_r(0x33, 0, 0, rd, rd, rs2); // c.add
+        case 026: // c.swsp
+            imm = (((p >> 9) & 0xF) << 2) | (((p >> 7) & 0x3) << 6);
+            return rvc_enc_s(2, 2, rs2, imm);
+        case 027: // c.sdsp
+            imm = (((p >> 10) & 0x7) << 3) | (((p >> 7) & 0x7) << 6);
+            return rvc_enc_s(3, 2, rs2, imm);
+        default: // FP loads/stores, reserved
+            return 0;
+    }
+}
+
+// =========================================
+// Parcel streams
+//
+// Splits raw fetch data (little-endian 16-bit parcels, mixed lengths) into
+// insts. Lengths come from the low bits of each inst's first parcel:
+//   xxxxxxxxxxxxxxaa  aa != 11     16-bit
+//   xxxxxxxxxxxbbb11  bbb != 111   32-bit
+//   xxxxxxxxxx011111               48-bit
+//   xxxxxxxxx0111111               64-bit
+//   xnnnxxxxx1111111  nnn != 111   (80 + 16 * nnn)-bit
+//   x111xxxxx1111111               reserved for >= 192-bit
+// Nothing is defined past 32 bits yet, so those print as unknown, but they're
+// still stepped over whole. The >= 192-bit space has no length field; it's
+// treated as a lone unknown parcel so decode can resync.
+//
+// RvParcelInst is repeated from rv_disass.h; the asserts below and
+// tests/parcel_stream.cpp pin both copies to the same layout.
+
+#define PARCEL_BLOCK 256
+
+typedef struct {
+    uint64_t    addr;
+    uint32_t    length;
+    uint32_t    inst;
+    const char* text;
+} RvParcelInst;
+
+RV_STATIC_ASSERT(sizeof(RvParcelInst) == 16 + sizeof(const char*), "RvParcelInst changed size");
+RV_LAYOUT(RvParcelInst, addr, 0);
+RV_LAYOUT(RvParcelInst, length, 8);
+RV_LAYOUT(RvParcelInst, inst, 12);
+RV_LAYOUT(RvParcelInst, text, 16);
+
+typedef int (*RvParcelFn)(void* ctx, const RvParcelInst* inst);
+
+// Length in parcels of an inst starting with p. The encodings are mutually
+// exclusive, so it's a plain sum of 0/1 terms; rv_parcel_lens4 is the same
+// sum on four parcels at once and this one only handles block tails.
+static inline uint8_t rv_parcel_len(uint16_t p) {
+    uint32_t nnn = (p >> 12) & 0x7;
+    uint32_t is32 = ((p & 0x3) == 0x3) & ((p & 0x1C) != 0x1C);
+    uint32_t is48 = ((p & 0x3F) == 0x1F);
+    uint32_t is64 = ((p & 0x7F) == 0x3F);
+    uint32_t isLong = ((p & 0x7F) == 0x7F) & (nnn != 0x7);
+    return (uint8_t)(1 + is32 + 2 * is48 + 3 * is64 + isLong * (4 + nnn));
+}
+
+// SWAR: four 16-bit parcels side by side in a uint64_t, one per lane. Plain
+// integer ops keep it parallel at any optimization level, rather than only
+// when the compiler chooses to vectorize.
+#define PARCEL_LANES 0x0001000100010001ull
+
+// 1 in each lane where (lane & mask) == val, 0 elsewhere. mask must fit in 15
+// bits, so adding 0x7FFF can't carry into the next lane.
+static inline uint64_t rv_lanes_eq(uint64_t w, uint32_t mask, uint32_t val) {
+    uint64_t diff = (w & (mask * PARCEL_LANES)) ^ (val * PARCEL_LANES);
+    return (~(diff + 0x7FFF * PARCEL_LANES) >> 15) & PARCEL_LANES;
+}
+
+// rv_parcel_len of each lane, in the same lane. Lengths are at most 11, so
+// the sum stays inside its lane too.
+static inline uint64_t rv_parcel_lens4(uint64_t w) {
+    uint64_t nnn = (w >> 12) & (0x7 * PARCEL_LANES);
+    uint64_t is32 = rv_lanes_eq(w, 0x3, 0x3) & ~rv_lanes_eq(w, 0x1C, 0x1C);
+    uint64_t is48 = rv_lanes_eq(w, 0x3F, 0x1F);
+    uint64_t is64 = rv_lanes_eq(w, 0x7F, 0x3F);
+    uint64_t isLong = rv_lanes_eq(w, 0x7F, 0x7F) & ~rv_lanes_eq(w, 0x7000, 0x7000);
+    return PARCEL_LANES + is32 + 2 * is48 + 3 * is64 + ((isLong * 0xFFFF) & (4 * PARCEL_LANES + nnn));
+}
+
+// Disassembles every whole inst in bytes, which is fetched from addr, calling
+// fn on each in order. fn returning nonzero stops early. Returns the number of
+// bytes consumed; a trailing partial inst is left over for the caller to
+// prepend to its next fetch. Returns (size_t)-1 (RV_PARCELS_FAILED) if it ran
+// out of memory; byte counts are always even, so that's never one.
+DPI_DLLESPEC size_t rv_disass_parcels(const void* bytes, size_t size, unsigned long long addr,
+                                      RvParcelFn fn, void* ctx) {
+    const uint8_t* in = (const uint8_t*)bytes;
+    size_t numParcels = size / 2;
+    size_t pos = 0; // In parcels
+    uint16_t parcels[PARCEL_BLOCK];
+    uint8_t lens[PARCEL_BLOCK];
+
+    for (size_t block = 0; block < numParcels; block += PARCEL_BLOCK) {
+        size_t count = numParcels - block;
+        if (count > PARCEL_BLOCK) {
+            count = PARCEL_BLOCK;
+        }
+        // Length of every parcel as if an inst started there...
+        for (size_t i = 0; i < count; i++) {
+            parcels[i] = (uint16_t)(in[2 * (block + i)] | (in[2 * (block + i) + 1] << 8));
+        }
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            uint64_t w = parcels[i] | ((uint64_t)parcels[i + 1] << 16) | ((uint64_t)parcels[i + 2] << 32) |
+                         ((uint64_t)parcels[i + 3] << 48);
+            uint64_t l = rv_parcel_lens4(w);
+            lens[i] = (uint8_t)l;
+            lens[i + 1] = (uint8_t)(l >> 16);
+            lens[i + 2] = (uint8_t)(l >> 32);
+            lens[i + 3] = (uint8_t)(l >> 48);
+        }
+        for (; i < count; i++) {
+            lens[i] = rv_parcel_len(parcels[i]);
+        }
+
+        // ...then the serial walk only hops between the ones that do.
+        while (pos < block + count) {
+            size_t len = lens[pos - block];
+            if (pos + len > numParcels) {
+                return pos * 2;
+            }
+            RvParcelInst rec;
+            rec.addr = addr + pos * 2;
+            rec.length = (uint32_t)len * 2;
+            rec.inst = parcels[pos - block];
+            if (len > 1) {
+                rec.inst |= (uint32_t)(in[2 * pos + 2] | (in[2 * pos + 3] << 8)) << 16;
+            }
+
+            char* disass;
+            if (len == 1) {
+                uint32_t expanded = rv_expand_compressed(rec.inst);
+                disass = expanded ? rv_disass_impl(expanded) : rv_fmt_unknown();
+            } else if (len == 2) {
+                disass = rv_disass_impl(rec.inst);
+            } else {
+                disass = rv_fmt_unknown();
+            }
+            if (disass == NULL) {
+                return (size_t)-1;
+            }
+            rec.text = disass;
+            int stop = fn(ctx, &rec);
+            free(disass);
+            pos += len;
+            if (stop) {
+                return pos * 2;
+            }
+        }
+    }
+    return pos * 2;
+}
+
+// =========================================
+// Raw retire traces
+//
+// Same layout as rv_disass.h, which the asserts below pin down.
+
+#define RV_TRACE_MAGIC   0x52545652 // "RVTR"
+#define RV_TRACE_VERSION 1
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t recordSize;
+    uint64_t reserved;
+} RvTraceHeader;
+
+typedef struct {
+    uint64_t pc;
+    uint64_t rdValue;
+    uint32_t inst;
+    uint8_t  rd;
+    uint8_t  reserved[3];
+    uint64_t cycle;
+    uint32_t hart;
+    uint32_t flags;
+} RvTraceRecord;
+
+// These are on disk: if one of these fires, bump RV_TRACE_VERSION and change
+// rv_disass.h and tests/raw_traces.cpp to match.
+RV_STATIC_ASSERT(sizeof(RvTraceHeader) == 16, "RvTraceHeader changed size");
+RV_LAYOUT(RvTraceHeader, magic, 0);
+RV_LAYOUT(RvTraceHeader, version, 4);
+RV_LAYOUT(RvTraceHeader, recordSize, 6);
+RV_LAYOUT(RvTraceHeader, reserved, 8);
+RV_STATIC_ASSERT(sizeof(RvTraceRecord) == 40, "RvTraceRecord changed size");
+RV_LAYOUT(RvTraceRecord, pc, 0);
+RV_LAYOUT(RvTraceRecord, rdValue, 8);
+RV_LAYOUT(RvTraceRecord, inst, 16);
+RV_LAYOUT(RvTraceRecord, rd, 20);
+RV_LAYOUT(RvTraceRecord, reserved, 21);
+RV_LAYOUT(RvTraceRecord, cycle, 24);
+RV_LAYOUT(RvTraceRecord, hart, 32);
+RV_LAYOUT(RvTraceRecord, flags, 36);
+
+static FILE* s_rawTrace = NULL;
+
+DPI_DLLESPEC void rv_rawtrace_close() {
+    if (s_rawTrace != NULL) {
+        fclose(s_rawTrace);
+        s_rawTrace = NULL;
+    }
+}
+
+// Starts a raw trace at path, replacing any trace already open. Returns 0 on success.
+DPI_DLLESPEC int rv_rawtrace_open(const char* path) {
+    rv_rawtrace_close();
+    s_rawTrace = fopen(path, "wb");
+    if (s_rawTrace == NULL) {
+        return -1;
+    }
+    setvbuf(s_rawTrace, NULL, _IOFBF, 1 << 20);
+
+    RvTraceHeader hdr = {RV_TRACE_MAGIC, RV_TRACE_VERSION, sizeof(RvTraceRecord), 0};
+    if (fwrite(&hdr, sizeof(hdr), 1, s_rawTrace) != 1) {
+        rv_rawtrace_close();
+        return -1;
+    }
+    return 0;
+}
+
+DPI_DLLESPEC void rv_rawtrace_put(int hart, unsigned long long cycle, unsigned long long pc,
+                                  unsigned int inst, unsigned char rd, unsigned long long rdValue) {
+    if (s_rawTrace == NULL) {
+        return;
+    }
+    RvTraceRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.pc = pc;
+    rec.rdValue = (rd != 0) ? rdValue : 0;
+    rec.inst = inst;
+    rec.rd = rd;
+    rec.cycle = cycle;
+    rec.hart = (uint32_t)hart;
+    fwrite(&rec, sizeof(rec), 1, s_rawTrace);
+}
+
+// =========================================
+// Pre-rendered ROM images
+//
+// ROMs loaded with $readmemh never change, so render every word once up front
+// and look the text up by PC afterwards. The sidecar file is flat and offset
+// based so it can be mmap'd as-is:
+//
+//   RomHeader | uint32_t words[count] | uint32_t offsets[count] | char text[textSize]
+//
+// offsets[i] indexes a NUL-terminated string in text, or ROM_ABSENT for holes
+// left by @addr jumps in the memh file. Images are rebased on their first
+// word, so an image that starts at @80000000 is as small as one at @0; what
+// still can't fit in ROM_MAX_WORDS is rejected rather than allocated.
+
+#define ROM_MAGIC   0x4d4f5256 // "VROM"
+#define ROM_VERSION 1
+#define ROM_ABSENT  0xFFFFFFFF
+#define ROM_MAX_LOADED 8
+#define ROM_MAX_WORDS  (1u << 24) // 64MiB of image
+
+#define ROM_STYLE_PSEUDO (1 << 0)
+#define ROM_STYLE_NO_ABI (1 << 1)
+#define ROM_STYLE_LLVM   (1 << 2)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t styleFlags; // ROM_STYLE_*, options the text was rendered with
+    uint32_t base;       // PC of words[0]
+    uint32_t count;
+    uint32_t textSize;
+} RomHeader;
+
+typedef struct {
+    const RomHeader* hdr;
+    const uint32_t*  words;
+    const uint32_t*  offsets;
+    const char*      text;
+    void*            storage;
+    size_t           storageSize;
+    bool             isMapped;
+} LoadedRom;
+
+static LoadedRom s_roms[ROM_MAX_LOADED];
+static uint32_t  s_numRoms = 0;
+
+static uint32_t rom_style_flags(void) {
+    return (g_context.UsePseudoInsts ? ROM_STYLE_PSEUDO : 0) |
+           (g_context.NoAbiNames     ? ROM_STYLE_NO_ABI : 0) |
+           (g_context.LlvmStyle      ? ROM_STYLE_LLVM   : 0);
+}
+
+// Parses $readmemh text: hex words, '@' address jumps (in words), // and /* */
+// comments, '_' separators. Words containing x/z are left as holes. words[0]
+// is the first word in the file, at address *origin_out.
+static int rom_read_memh(FILE* f, uint32_t** words_out, bool** present_out, uint32_t* count_out,
+                         uint32_t* origin_out) {
+    uint32_t* words = NULL;
+    bool*     present = NULL;
+    size_t    cap = 0;
+    size_t    count = 0;
+    uint64_t  addr = 0;
+    uint64_t  origin = 0;
+    bool      haveOrigin = false;
+    char tok[64];
+
+    int c = fgetc(f);
+    while (c != EOF) {
+        if (isspace(c)) {
+            c = fgetc(f);
+            continue;
+        }
+        if (c == '/') {
+            int next = fgetc(f);
+            if (next == '/') {
+                while (c != EOF && c != '\n') {
+                    c = fgetc(f);
+                }
+                continue;
+            } else if (next == '*') {
+                int prev = 0;
+                c = fgetc(f);
+                while (c != EOF && !(prev == '*' && c == '/')) {
+                    prev = c;
+                    c = fgetc(f);
+                }
+                c = fgetc(f);
+                continue;
+            }
+            goto fail;
+        }
+
+        size_t len = 0;
+        while (c != EOF && !isspace(c) && c != '/') {
+            if (len + 1 >= sizeof(tok)) {
+                goto fail;
+            }
+            tok[len++] = (char)c;
+            c = fgetc(f);
+        }
+        tok[len] = 0;
+
+        bool isAddr = (tok[0] == '@');
+        bool unknown = false;
+        uint64_t val = 0;
+        for (const char* p = tok + (isAddr ? 1 : 0); *p; p++) {
+            if (*p == '_') {
+                continue;
+            } else if (isxdigit((unsigned char)*p)) {
+                val = (val << 4) | (uint64_t)(isdigit((unsigned char)*p) ? *p - '0' : (tolower((unsigned char)*p) - 'a' + 10));
+            } else if (strchr("xXzZ", *p) != NULL && !isAddr) {
+                unknown = true;
+            } else {
+                goto fail;
+            }
+            if (val > 0xFFFFFFFF) {
+                goto fail;
+            }
+        }
+
+        if (isAddr) {
+            addr = val;
+            continue;
+        }
+
+        if (!haveOrigin) {
+            origin = addr;
+            haveOrigin = true;
+        }
+        if (addr < origin || addr - origin >= ROM_MAX_WORDS) {
+            goto fail; // Before the first word, or too sparse to hold in one image
+        }
+        size_t idx = (size_t)(addr - origin);
+        if (idx >= cap) {
+            size_t newCap = cap ? cap : 1024;
+            while (newCap <= idx) {
+                newCap *= 2;
+            }
+            uint32_t* newWords = (uint32_t*)realloc(words, newCap * sizeof(*words));
+            bool* newPresent = (bool*)realloc(present, newCap * sizeof(*present));
+            if (newWords == NULL || newPresent == NULL) {
+                free(newWords ? newWords : words);
+                free(newPresent ? newPresent : present);
+                return -1;
+            }
+            memset(newPresent + cap, 0, (newCap - cap) * sizeof(*present));
+            words = newWords;
+            present = newPresent;
+            cap = newCap;
+        }
+        words[idx] = (uint32_t)val;
+        present[idx] = !unknown;
+        addr++;
+        if (idx + 1 > count) {
+            count = idx + 1;
+        }
+    }
+
+    *words_out = words;
+    *present_out = present;
+    *count_out = (uint32_t)count;
+    *origin_out = (uint32_t)origin;
+    return 0;
+
+fail:
+    free(words);
+    free(present);
+    return -1;
+}
+
+// Raw little-endian 32-bit words.
+static int rom_read_bin(FILE* f, uint32_t** words_out, bool** present_out, uint32_t* count_out) {
+    if (fseek(f, 0, SEEK_END) != 0) {
+        return -1;
+    }
+    long size = ftell(f);
+    if (size < 0 || fseek(f, 0, SEEK_SET) != 0) {
+        return -1;
+    }
+
+    if (size / 4 > ROM_MAX_WORDS) {
+        return -1;
+    }
+    uint32_t count = (uint32_t)(size / 4);
+    uint32_t* words = (uint32_t*)malloc(count * sizeof(*words) + 1);
+    bool* present = (bool*)malloc(count * sizeof(*present) + 1);
+    if (words == NULL || present == NULL) {
+        free(words);
+        free(present);
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t b[4];
+        if (fread(b, 1, 4, f) != 4) {
+            free(words);
+            free(present);
+            return -1;
+        }
+        words[i] = (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+        present[i] = true;
+    }
+
+    *words_out = words;
+    *present_out = present;
+    *count_out = count;
+    return 0;
+}
+
+// Renders image (memh text, or raw binary if isBinary) with the current
+// options and writes the sidecar. Returns 0 on success.
+DPI_DLLESPEC int rv_rom_prerender(const char* image, unsigned int base, char isBinary, const char* sidecar) {
+    FILE* in = fopen(image, isBinary ? "rb" : "r");
+    if (in == NULL) {
+        return -1;
+    }
+    uint32_t* words = NULL;
+    bool* present = NULL;
+    uint32_t count = 0;
+    uint32_t origin = 0;
+    int err = isBinary ? rom_read_bin(in, &words, &present, &count)
+                       : rom_read_memh(in, &words, &present, &count, &origin);
+    fclose(in);
+    if (err != 0) {
+        return -1;
+    }
+
+    uint32_t* offsets = (uint32_t*)malloc(count * sizeof(*offsets) + 1);
+    char* text = NULL;
+    size_t textSize = 0;
+    size_t textCap = 0;
+    bool ok = (offsets != NULL);
+    for (uint32_t i = 0; ok && i < count; i++) {
+        if (!present[i]) {
+            words[i] = 0;
+            offsets[i] = ROM_ABSENT;
+            continue;
+        }
+        char* disass = rv_disass_impl(words[i]);
+        if (disass == NULL) {
+            ok = false;
+            break;
+        }
+        size_t len = strlen(disass) + 1;
+        if (textSize + len > textCap) {
+            size_t newCap = textCap ? textCap * 2 : 4096;
+            while (newCap < textSize + len) {
+                newCap *= 2;
+            }
+            char* newText = (newCap < ROM_ABSENT) ? (char*)realloc(text, newCap) : NULL;
+            if (newText == NULL) {
+                free(disass);
+                ok = false;
+                break;
+            }
+            text = newText;
+            textCap = newCap;
+        }
+        memcpy(text + textSize, disass, len);
+        offsets[i] = (uint32_t)textSize;
+        textSize += len;
+        free(disass);
+    }
+
+    FILE* out = ok ? fopen(sidecar, "wb") : NULL;
+    if (out != NULL) {
+        RomHeader hdr = {ROM_MAGIC, ROM_VERSION, rom_style_flags(), base + origin * 4, count, (uint32_t)textSize};
+        ok = fwrite(&hdr, sizeof(hdr), 1, out) == 1 &&
+             fwrite(words, sizeof(*words), count, out) == count &&
+             fwrite(offsets, sizeof(*offsets), count, out) == count &&
+             fwrite(text, 1, textSize, out) == textSize;
+        ok = (fclose(out) == 0) && ok;
+    } else {
+        ok = false;
+    }
+
+    free(words);
+    free(present);
+    free(offsets);
+    free(text);
+    return ok ? 0 : -1;
+}
+
+// Maps a sidecar made by rv_rom_prerender. Up to ROM_MAX_LOADED images
+// (boot ROM, test program, ...) can be loaded at once. Returns 0 on success.
+DPI_DLLESPEC int rv_rom_load(const char* sidecar) {
+    if (s_numRoms >= ROM_MAX_LOADED) {
+        return -1;
+    }
+
+    LoadedRom rom;
+    memset(&rom, 0, sizeof(rom));
+#ifndef _WIN32
+    int fd = open(sidecar, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(RomHeader)) {
+        close(fd);
+        return -1;
+    }
+    rom.storageSize = (size_t)st.st_size;
+    rom.storage = mmap(NULL, rom.storageSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (rom.storage == MAP_FAILED) {
+        return -1;
+    }
+    rom.isMapped = true;
+#else
+    FILE* f = fopen(sidecar, "rb");
+    if (f == NULL) {
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    rom.storageSize = (size > 0) ? (size_t)size : 0;
+    rom.storage = malloc(rom.storageSize + 1);
+    if (rom.storage == NULL || rom.storageSize < sizeof(RomHeader) ||
+        fread(rom.storage, 1, rom.storageSize, f) != rom.storageSize) {
+        fclose(f);
+        free(rom.storage);
+        return -1;
+    }
+    fclose(f);
+#endif
+
+    rom.hdr = (const RomHeader*)rom.storage;
+    uint64_t expected = sizeof(RomHeader) + (uint64_t)rom.hdr->count * 8 + rom.hdr->textSize;
+    bool ok = rom.hdr->magic == ROM_MAGIC && rom.hdr->version == ROM_VERSION &&
+              expected == rom.storageSize;
+    if (ok) {
+        rom.words   = (const uint32_t*)(rom.hdr + 1);
+        rom.offsets = rom.words + rom.hdr->count;
+        rom.text    = (const char*)(rom.offsets + rom.hdr->count);
+        // rv_disass_at hands these strings straight to the sim, so every one
+        // has to start inside text and end at a NUL before its end.
+        ok = rom.hdr->textSize != 0 && rom.text[rom.hdr->textSize - 1] == 0;
+        for (uint32_t i = 0; ok && i < rom.hdr->count; i++) {
+            ok = rom.offsets[i] == ROM_ABSENT || rom.offsets[i] < rom.hdr->textSize;
+        }
+    }
+    if (!ok) {
+#ifndef _WIN32
+        munmap(rom.storage, rom.storageSize);
+#else
+        free(rom.storage);
+#endif
+        return -1;
+    }
+
+    s_roms[s_numRoms++] = rom;
+    return 0;
+}
+
+DPI_DLLESPEC void rv_rom_unload_all() {
+    for (uint32_t i = 0; i < s_numRoms; i++) {
+#ifndef _WIN32
+        munmap(s_roms[i].storage, s_roms[i].storageSize);
+#else
+        free(s_roms[i].storage);
+#endif
+    }
+    memset(s_roms, 0, sizeof(s_roms));
+    s_numRoms = 0;
+}
+
+// Like rv_disass, but served from a loaded ROM when pc falls in one and inst
+// is still what the image says is there. Anything else (self-modifying code,
+// PCs outside every image, different options) is disassembled live.
+DPI_DLLESPEC const char* rv_disass_at(unsigned int pc, int raw_inst) {
+    uint32_t inst = (uint32_t)raw_inst;
+    for (uint32_t i = 0; i < s_numRoms; i++) {
+        const LoadedRom* rom = &s_roms[i];
+        uint32_t delta = pc - rom->hdr->base;
+        uint32_t idx = delta / 4;
+        if ((delta & 3) != 0 || idx >= rom->hdr->count) {
+            continue;
+        }
+        if (rom->offsets[idx] == ROM_ABSENT || rom->words[idx] != inst ||
+            rom->hdr->styleFlags != rom_style_flags()) {
+            break;
+        }
+        const char* text = rom->text + rom->offsets[idx];
+        // Table strings are never freed; hand out a copy to sims that will.
+        return g_context.SimDoesCopy ? text : strdup(text);
+    }
+    return rv_disass(raw_inst);
+}
+
+// =========================================
+// Functional coverage
+//
+// Bins live in small per-opcode bitmaps, so a sample is one decode plus a few
+// ORs; nothing is formatted until rv_cov_report. Bins are:
+//   opcode x register class, for each of rd/rs1/rs2 the layout has
+//   opcode x immediate corner (0, -1, min, max, other +/-)
+//   opcode x pseudo-instruction form
+
+typedef enum {
+    RegClass_Zero,
+    RegClass_Ra,
+    RegClass_Sp,
+    RegClass_GpTp,
+    RegClass_Temp,
+    RegClass_Saved,
+    RegClass_Arg,
+    RegClass_Count,
+} RegClass;
+
+static const uint8_t RegClassOf[32] = {
+    RegClass_Zero, RegClass_Ra, RegClass_Sp, RegClass_GpTp, RegClass_GpTp,
+    RegClass_Temp, RegClass_Temp, RegClass_Temp, RegClass_Saved, RegClass_Saved,
+    RegClass_Arg, RegClass_Arg, RegClass_Arg, RegClass_Arg,
+    RegClass_Arg, RegClass_Arg, RegClass_Arg, RegClass_Arg,
+    RegClass_Saved, RegClass_Saved, RegClass_Saved, RegClass_Saved, RegClass_Saved,
+    RegClass_Saved, RegClass_Saved, RegClass_Saved, RegClass_Saved, RegClass_Saved,
+    RegClass_Temp, RegClass_Temp, RegClass_Temp, RegClass_Temp,
+};
+static const char* const RegClassNames[RegClass_Count] = {
+    "zero", "ra", "sp", "gp/tp", "t*", "s*", "a*"
+};
+
+typedef enum {
+    ImmCorner_Zero,
+    ImmCorner_NegOne,
+    ImmCorner_Min,
+    ImmCorner_Max,
+    ImmCorner_OtherPos,
+    ImmCorner_OtherNeg,
+    ImmCorner_Count,
+} ImmCorner;
+
+static const char* const ImmCornerNames[ImmCorner_Count] = {
+    "0", "-1", "min", "max", "+", "-"
+};
+
+static const char* const PseudoFormNames[PseudoForm_Count] = {
+    "", "nop", "li", "mv", "not", "sext.w", "seqz",
+    "ret", "jr", "jr(off)", "jalr(ra)", "jalr(ra,off)", "jalr(no off)",
+    "fence", "fence.tso", "blez", "b*z", "bgtz",
+    "neg", "negw", "snez", "sltz", "sgtz", "j", "jal(ra)"
+};
+
+#define COV_RD  (1 << 0)
+#define COV_RS1 (1 << 1)
+#define COV_RS2 (1 << 2)
+#define COV_IMM (1 << 3)
+
+typedef struct {
+    uint8_t fields;  // COV_*
+    int32_t immMin;
+    int32_t immMax;
+} LayoutCoverage;
+
+// Indexed by InstLayout
+static const LayoutCoverage LayoutCoverages[] = {
+    {COV_RD | COV_RS1 | COV_RS2, 0, 0},          // R
+    {0, 0, 0},                                   // R_shamt5
+    {0, 0, 0},                                   // R_shamt6
+    {COV_RD | COV_RS1 | COV_IMM, -2048, 2047},   // I
+    {COV_RD | COV_RS1 | COV_IMM, -2048, 2047},   // I_jump
+    {COV_RD | COV_RS1 | COV_IMM, -2048, 2047},   // I_load
+    {0, 0, 0},                                   // I_fence
+    {COV_RD | COV_RS1 | COV_IMM, 0, 63},         // I_shift, narrowed by the op's mask
+    {COV_RS1 | COV_RS2 | COV_IMM, -2048, 2047},  // S
+    {COV_RS1 | COV_RS2 | COV_IMM, -4096, 4094},  // B
+    {COV_RD | COV_IMM, -524288, 524287},         // U
+    {COV_RD | COV_IMM, -1048576, 1048574},       // J
+    {COV_RD | COV_RS1, 0, 0},                    // Csr
+    {COV_RD | COV_IMM, 0, 31},                   // CsrImm
+    {0, 0, 0},                                   // None
+};
+
+typedef struct {
+    uint64_t samples;
+    uint32_t pseudo; // PseudoForm bitmap
+    uint8_t  rd;     // RegClass bitmaps
+    uint8_t  rs1;
+    uint8_t  rs2;
+    uint8_t  imm;    // ImmCorner bitmap
+} OpCoverage;
+
+static OpCoverage s_opCoverage[UNCOMPRESSED_INSTS_COUNT];
+static uint64_t   s_unknownSamples = 0;
+
+static void rv_cov_imm_range(const OpInfo* info, int32_t* min, int32_t* max) {
+    *min = LayoutCoverages[info->layout].immMin;
+    *max = LayoutCoverages[info->layout].immMax;
+    if (info->layout == InstLayout_I_shift) {
+        *max = (int32_t)((~info->searchMask & MASK_SHMT) >> SHIFT_SHMT);
+    }
+}
+
+static int32_t rv_cov_imm(uint32_t inst, InstLayout layout) {
+    switch (layout) {
+        case InstLayout_I:
+        case InstLayout_I_jump:
+        case InstLayout_I_load:
+            return (int32_t)rv_imm_i(inst);
+        case InstLayout_I_shift:
+            return (int32_t)DEC_SHMT(inst);
+        case InstLayout_S:
+            return (int32_t)rv_imm_s(inst);
+        case InstLayout_B:
+            return (int32_t)rv_imm_b(inst);
+        case InstLayout_U:
+            return (int32_t)inst >> SHIFT_I20;
+        case InstLayout_J:
+            return (int32_t)rv_imm_j(inst);
+        case InstLayout_CsrImm:
+            return (int32_t)DEC_RS1(inst);
+        default:
+            return 0;
+    }
+}
+
+static uint8_t rv_cov_imm_corner(int32_t imm, int32_t min, int32_t max) {
+    if (imm == 0) {
+        return 1 << ImmCorner_Zero;
+    } else if (imm == min) {
+        return 1 << ImmCorner_Min;
+    } else if (imm == max) {
+        return 1 << ImmCorner_Max;
+    } else if (imm == -1) {
+        return 1 << ImmCorner_NegOne;
+    }
+    return (imm > 0) ? (1 << ImmCorner_OtherPos) : (1 << ImmCorner_OtherNeg);
+}
+
+// Bins an op could ever hit, as the same bitmaps a sample sets.
+static OpCoverage rv_cov_possible(const OpInfo* info) {
+    OpCoverage possible;
+    memset(&possible, 0, sizeof(possible));
+    uint8_t fields = LayoutCoverages[info->layout].fields;
+    uint8_t allRegs = (1 << RegClass_Count) - 1;
+    possible.rd  = (fields & COV_RD)  ? allRegs : 0;
+    possible.rs1 = (fields & COV_RS1) ? allRegs : 0;
+    possible.rs2 = (fields & COV_RS2) ? allRegs : 0;
+
+    if (fields & COV_IMM) {
+        int32_t min, max;
+        rv_cov_imm_range(info, &min, &max);
+        possible.imm = (1 << ImmCorner_Zero) | (1 << ImmCorner_Max) | (1 << ImmCorner_OtherPos);
+        if (min < 0) {
+            possible.imm |= (1 << ImmCorner_Min) | (1 << ImmCorner_OtherNeg);
+        }
+        if (min < 0 && (max & 1)) {
+            // Branch/jump offsets are always even, so only odd-max ranges reach -1.
+            possible.imm |= (1 << ImmCorner_NegOne);
+        }
+    }
+
+    uint32_t flags = info->pseudoInstFlags;
+    switch (info->layout) {
+        case InstLayout_I:
+            possible.pseudo |= (flags & PS_I_NOP)  ? (1 << PseudoForm_Nop)   : 0;
+            possible.pseudo |= (flags & PS_I_LI)   ? (1 << PseudoForm_Li)    : 0;
+            possible.pseudo |= (flags & PS_I_MV)   ? (1 << PseudoForm_Mv)    : 0;
+            possible.pseudo |= (flags & PS_I_NOT)  ? (1 << PseudoForm_Not)   : 0;
+            possible.pseudo |= (flags & PS_I_SEXT) ? (1 << PseudoForm_SextW) : 0;
+            possible.pseudo |= (flags & PS_I_SEQZ) ? (1 << PseudoForm_Seqz)  : 0;
+            break;
+        case InstLayout_I_jump:
+            possible.pseudo = (1 << PseudoForm_Ret) | (1 << PseudoForm_Jr) | (1 << PseudoForm_JrOffset) |
+                              (1 << PseudoForm_JalrRa) | (1 << PseudoForm_JalrRaOffset) |
+                              (1 << PseudoForm_JalrNoOffset);
+            break;
+        case InstLayout_I_fence:
+            possible.pseudo = (1 << PseudoForm_Fence) | (1 << PseudoForm_FenceTso);
+            break;
+        case InstLayout_B:
+            possible.pseudo |= (flags & PS_B_BLEZ)  ? (1 << PseudoForm_Blez)    : 0;
+            possible.pseudo |= (flags & PS_B_ANY_Z) ? (1 << PseudoForm_BranchZ) : 0;
+            possible.pseudo |= (flags & PS_B_BGTZ)  ? (1 << PseudoForm_Bgtz)    : 0;
+            break;
+        case InstLayout_R:
+            possible.pseudo |= (flags & PS_R_NEG)  ? (1 << PseudoForm_Neg)  : 0;
+            possible.pseudo |= (flags & PS_R_NEGW) ? (1 << PseudoForm_Negw) : 0;
+            possible.pseudo |= (flags & PS_R_SNEZ) ? (1 << PseudoForm_Snez) : 0;
+            possible.pseudo |= (flags & PS_R_SLTZ) ? (1 << PseudoForm_Sltz) : 0;
+            possible.pseudo |= (flags & PS_R_SGTZ) ? (1 << PseudoForm_Sgtz) : 0;
+            break;
+        case InstLayout_J:
+            possible.pseudo = (1 << PseudoForm_J) | (1 << PseudoForm_JalRa);
+            break;
+        default:
+            break;
+    }
+    return possible;
+}
+
+static uint32_t rv_cov_count(const OpCoverage* cov) {
+    return __builtin_popcount(cov->rd) + __builtin_popcount(cov->rs1) + __builtin_popcount(cov->rs2) +
+           __builtin_popcount(cov->imm) + __builtin_popcount(cov->pseudo);
+}
+
+DPI_DLLESPEC void rv_cov_sample(unsigned int inst) {
+    const OpInfo* info = rv_find_op(inst);
+    if (info == NULL) {
+        s_unknownSamples++;
+        return;
+    }
+
+    OpCoverage* cov = &s_opCoverage[info - UncompressedInsts];
+    uint8_t fields = LayoutCoverages[info->layout].fields;
+    cov->samples++;
+    if (fields & COV_RD) {
+        cov->rd |= 1 << RegClassOf[DEC_RD(inst)];
+    }
+    if (fields & COV_RS1) {
+        cov->rs1 |= 1 << RegClassOf[DEC_RS1(inst)];
+    }
+    if (fields & COV_RS2) {
+        cov->rs2 |= 1 << RegClassOf[DEC_RS2(inst)];
+    }
+    if (fields & COV_IMM) {
+        int32_t min, max;
+        rv_cov_imm_range(info, &min, &max);
+        cov->imm |= rv_cov_imm_corner(rv_cov_imm(inst, info->layout), min, max);
+    }
+    cov->pseudo |= 1u << rv_pseudo_form(inst, info);
+}
+
+DPI_DLLESPEC void rv_cov_reset() {
+    memset(s_opCoverage, 0, sizeof(s_opCoverage));
+    s_unknownSamples = 0;
+}
+
+DPI_DLLESPEC int rv_cov_bins_hit() {
+    uint32_t hit = 0;
+    for (uint32_t i = 0; i < UncompressedInstsSize; i++) {
+        OpCoverage possible = rv_cov_possible(&UncompressedInsts[i]);
+        OpCoverage cov = s_opCoverage[i];
+        cov.rd &= possible.rd;
+        cov.rs1 &= possible.rs1;
+        cov.rs2 &= possible.rs2;
+        cov.imm &= possible.imm;
+        cov.pseudo &= possible.pseudo;
+        hit += rv_cov_count(&cov) + (cov.samples != 0);
+    }
+    return (int)hit;
+}
+
+DPI_DLLESPEC int rv_cov_bins_total() {
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < UncompressedInstsSize; i++) {
+        OpCoverage possible = rv_cov_possible(&UncompressedInsts[i]);
+        total += rv_cov_count(&possible) + 1; // +1: the op itself
+    }
+    return (int)total;
+}
+
+static void rv_cov_report_missing(FILE* out, bool* first, const char* field, uint32_t missing,
+                                  const char* const* names, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (missing & (1u << i)) {
+            fprintf(out, "%s%s:%s", *first ? "    missing: " : " ", field, names[i]);
+            *first = false;
+        }
+    }
+}
+
+// Writes a per-opcode report to path (stdout if NULL or empty). Returns 0 on success.
+DPI_DLLESPEC int rv_cov_report(const char* path) {
+    bool toStdout = (path == NULL || path[0] == 0);
+    FILE* out = toStdout ? stdout : fopen(path, "w");
+    if (out == NULL) {
+        return -1;
+    }
+
+    int hit = rv_cov_bins_hit();
+    int total = rv_cov_bins_total();
+    uint64_t samples = s_unknownSamples;
+    for (uint32_t i = 0; i < UncompressedInstsSize; i++) {
+        samples += s_opCoverage[i].samples;
+    }
+    fprintf(out, "RISC-V encoding coverage: %d/%d bins (%.1f%%), %llu samples, %llu unknown\n",
+            hit, total, total ? 100.0 * hit / total : 0.0,
+            (unsigned long long)samples, (unsigned long long)s_unknownSamples);
+
+    for (uint32_t i = 0; i < UncompressedInstsSize; i++) {
+        const OpInfo* info = &UncompressedInsts[i];
+        const OpCoverage* cov = &s_opCoverage[i];
+        OpCoverage possible = rv_cov_possible(info);
+
+        fprintf(out, "%-8s %12llu", info->name, (unsigned long long)cov->samples);
+        if (possible.rd) {
+            fprintf(out, "  rd %d/%d", __builtin_popcount(cov->rd & possible.rd), __builtin_popcount(possible.rd));
+        }
+        if (possible.rs1) {
+            fprintf(out, "  rs1 %d/%d", __builtin_popcount(cov->rs1 & possible.rs1), __builtin_popcount(possible.rs1));
+        }
+        if (possible.rs2) {
+            fprintf(out, "  rs2 %d/%d", __builtin_popcount(cov->rs2 & possible.rs2), __builtin_popcount(possible.rs2));
+        }
+        if (possible.imm) {
+            fprintf(out, "  imm %d/%d", __builtin_popcount(cov->imm & possible.imm), __builtin_popcount(possible.imm));
+        }
+        if (possible.pseudo) {
+            fprintf(out, "  pseudo %d/%d", __builtin_popcount(cov->pseudo & possible.pseudo), __builtin_popcount(possible.pseudo));
+        }
+        fputc('\n', out);
+
+        if (cov->samples == 0) {
+            continue; // Everything is missing; no point listing it.
+        }
+        bool first = true;
+        rv_cov_report_missing(out, &first, "rd", possible.rd & ~cov->rd, RegClassNames, RegClass_Count);
+        rv_cov_report_missing(out, &first, "rs1", possible.rs1 & ~cov->rs1, RegClassNames, RegClass_Count);
+        rv_cov_report_missing(out, &first, "rs2", possible.rs2 & ~cov->rs2, RegClassNames, RegClass_Count);
+        rv_cov_report_missing(out, &first, "imm", possible.imm & ~cov->imm, ImmCornerNames, ImmCorner_Count);
+        rv_cov_report_missing(out, &first, "pseudo", possible.pseudo & ~cov->pseudo, PseudoFormNames, PseudoForm_Count);
+        if (!first) {
+            fputc('\n', out);
+        }
+    }
+
+    if (toStdout) {
+        fflush(out);
+        return 0;
+    }
+    return (fclose(out) == 0) ? 0 : -1;
+}
+
+// =========================================
+// Register dataflow
+//
+// With rv_trace_set_dataflow on, every inst the text trace sees (traced or
+// gated out) goes through a per-hart last-writer table of the 32 registers,
+// O(1) per inst. Traced lines get each source register's producer appended
+// (how many insts back, and its pc), and every distance lands in the
+// histograms rv_trace_dataflow_report prints. rv_trace_inst has a table of
+// its own, so mixing it with rv_trace_hart_inst doesn't tangle it with hart 0.
+
+#define TRACE_MAX_HARTS 64
+#define DF_SINGLE_HART  TRACE_MAX_HARTS // rv_trace_inst's table, after the per-hart ones
+#define DF_MAX_DISTANCE 64 // Histogram bucket for this far back or further
+#define DF_NEAR_BUCKETS 4  // Per producer opcode: 1, 2, 3 and 4+ back
+
+typedef struct {
+    uint64_t seq;           // Insts seen so far on this hart
+    uint64_t writerSeq[32]; // seq of each register's last writer, 0 if none yet
+    uint64_t writerPc[32];
+    int16_t  writerOp[32];
+} DataflowHart;
+
+static bool s_dataflowEnabled = false;
+static DataflowHart s_dataflowHarts[TRACE_MAX_HARTS + 1];
+static uint64_t s_dataflowHist[DF_MAX_DISTANCE + 1]; // [0]: no earlier writer
+static uint64_t s_dataflowByOp[UNCOMPRESSED_INSTS_COUNT][DF_NEAR_BUCKETS];
+
+static void rv_dataflow_reset_tables(void) {
+    memset(s_dataflowHarts, 0, sizeof(s_dataflowHarts));
+}
+
+// Updates the tables and histograms for one retired inst. If deps isn't
+// NULL, also writes the annotation for its trace line there ("" if none).
+// hart is a table index: a hart number, or DF_SINGLE_HART. Anything past that
+// isn't tracked rather than landing in another hart's table.
+static void rv_dataflow_step(uint32_t hart, uint64_t pc, uint32_t inst, char* deps, size_t size) {
+    if (deps != NULL) {
+        deps[0] = 0;
+    }
+    if (hart > DF_SINGLE_HART) {
+        return;
+    }
+    DataflowHart* df = &s_dataflowHarts[hart];
+    int rd, rs[2], csr;
+    int op = rv_decode_fields(inst, &rd, &rs[0], &rs[1], &csr);
+    uint64_t seq = ++df->seq;
+
+    size_t len = 0;
+    for (int i = 0; i < 2; i++) {
+        int reg = rs[i];
+        if (reg <= 0 || (i == 1 && reg == rs[0])) {
+            continue; // x0 has no producer
+        }
+        if (df->writerSeq[reg] == 0) {
+            s_dataflowHist[0]++;
+            continue;
+        }
+        uint64_t dist = seq - df->writerSeq[reg];
+        s_dataflowHist[(dist < DF_MAX_DISTANCE) ? dist : DF_MAX_DISTANCE]++;
+        s_dataflowByOp[df->writerOp[reg]][(dist < DF_NEAR_BUCKETS) ? dist - 1 : DF_NEAR_BUCKETS - 1]++;
+        if (deps != NULL && len < size) {
+            int n = snprintf(deps + len, size - len, "%s %s:%llu@%llx", (len == 0) ? "  deps" : "",
+                             get_abi_name((uint8_t)reg), (unsigned long long)dist,
+                             (unsigned long long)df->writerPc[reg]);
+            len += (n > 0) ? (size_t)n : 0;
+        }
+    }
+
+    if (rd > 0) {
+        df->writerSeq[rd] = seq;
+        df->writerPc[rd] = pc;
+        df->writerOp[rd] = (int16_t)op;
+    }
+}
+
+// Turns dataflow annotation on or off, clearing the tables and histograms.
+DPI_DLLESPEC void rv_trace_set_dataflow(char enabled) {
+    s_dataflowEnabled = enabled;
+    rv_dataflow_reset_tables();
+    memset(s_dataflowHist, 0, sizeof(s_dataflowHist));
+    memset(s_dataflowByOp, 0, sizeof(s_dataflowByOp));
+}
+
+// Source reads whose producer was `distance` insts back. 0 counts reads with
+// no earlier writer; DF_MAX_DISTANCE (64) and up share the last bucket.
+DPI_DLLESPEC unsigned long long rv_trace_dataflow_hist(int distance) {
+    if (distance < 0) {
+        return 0;
+    }
+    return s_dataflowHist[(distance < DF_MAX_DISTANCE) ? distance : DF_MAX_DISTANCE];
+}
+
+// Writes the distance histogram, then near dependencies by producer opcode,
+// to path (stdout if NULL or empty). Returns 0 on success.
+DPI_DLLESPEC int rv_trace_dataflow_report(const char* path) {
+    bool toStdout = (path == NULL || path[0] == 0);
+    FILE* out = toStdout ? stdout : fopen(path, "w");
+    if (out == NULL) {
+        return -1;
+    }
+
+    uint64_t reads = 0;
+    for (uint32_t d = 0; d <= DF_MAX_DISTANCE; d++) {
+        reads += s_dataflowHist[d];
+    }
+    fprintf(out, "Register dataflow: %llu source reads, %llu with no earlier writer\n",
+            (unsigned long long)reads, (unsigned long long)s_dataflowHist[0]);
+    fprintf(out, "distance        reads       %%    cum%%\n");
+    uint64_t cumulative = s_dataflowHist[0];
+    for (uint32_t d = 1; d <= DF_MAX_DISTANCE; d++) {
+        cumulative += s_dataflowHist[d];
+        if (s_dataflowHist[d] == 0) {
+            continue;
+        }
+        fprintf(out, "%7u%s %12llu  %5.1f%%  %5.1f%%\n", d, (d == DF_MAX_DISTANCE) ? "+" : " ",
+                (unsigned long long)s_dataflowHist[d], 100.0 * s_dataflowHist[d] / reads,
+                100.0 * cumulative / reads);
+    }
+
+    fprintf(out, "producer            1            2            3           4+\n");
+    for (uint32_t i = 0; i < UncompressedInstsSize; i++) {
+        const uint64_t* near = s_dataflowByOp[i];
+        if ((near[0] | near[1] | near[2] | near[3]) == 0) {
+            continue;
+        }
+        fprintf(out, "%-8s %12llu %12llu %12llu %12llu\n", UncompressedInsts[i].name,
+                (unsigned long long)near[0], (unsigned long long)near[1],
+                (unsigned long long)near[2], (unsigned long long)near[3]);
+    }
+
+    if (toStdout) {
+        fflush(out);
+        return 0;
+    }
+    return (fclose(out) == 0) ? 0 : -1;
+}
+
+// =========================================
+// Gated text traces
+//
+// Most of a full-run trace is noise. The filter is parsed once into plain
+// integer tests that run on the raw word, so instructions that don't pass
+// never reach the formatter (or cross the DPI boundary as a string).
+
+#define TRACE_MAX_PC_RANGES 8
+
+typedef struct {
+    bool     enabled;
+    uint32_t mask;
+    uint32_t match;
+} InstTrigger;
+
+typedef struct {
+    uint32_t    numPcRanges;  // 0 = any pc
+    uint64_t    pcLo[TRACE_MAX_PC_RANGES];
+    uint64_t    pcHi[TRACE_MAX_PC_RANGES]; // exclusive
+    uint64_t    cycleLo;
+    uint64_t    cycleHi;      // exclusive
+    bool        filterOps;
+    uint8_t     ops[(UNCOMPRESSED_INSTS_COUNT + 7) / 8]; // bitmap by opcode ID
+    uint32_t    sampleRate;   // keep 1 in N of what passes everything else
+    InstTrigger start;        // tracing stays off until this retires...
+    InstTrigger stop;         // ...and goes off again after this one
+} TraceFilter;
+
+typedef struct {
+    bool     triggered;
+    uint32_t sampleCount;
+} TraceGateState;
+
+static TraceFilter    s_traceFilter = {0, {0}, {0}, 0, UINT64_MAX, false, {0}, 1, {false, 0, 0}, {false, 0, 0}};
+static TraceGateState s_traceGate = {true, 0};
+static FILE*          s_textTrace = NULL;
+
+static void rv_trace_filter_init(TraceFilter* filter) {
+    memset(filter, 0, sizeof(*filter));
+    filter->cycleHi = UINT64_MAX;
+    filter->sampleRate = 1;
+}
+
+static void rv_trace_gate_init(TraceGateState* gate, const TraceFilter* filter) {
+    gate->triggered = !filter->start.enabled;
+    gate->sampleCount = 0;
+}
+
+static bool rv_trace_gate_impl(const TraceFilter* filter, TraceGateState* gate,
+                               uint64_t cycle, uint64_t pc, uint32_t inst) {
+    // Triggers watch every inst; both the start and stop insts get traced.
+    if (!gate->triggered) {
+        if (!filter->start.enabled || (inst & filter->start.mask) != filter->start.match) {
+            return false;
+        }
+        gate->triggered = true;
+    } else if (filter->stop.enabled && (inst & filter->stop.mask) == filter->stop.match) {
+        gate->triggered = false;
+    }
+
+    if (cycle < filter->cycleLo || cycle >= filter->cycleHi) {
+        return false;
+    }
+    if (filter->numPcRanges != 0) {
+        bool inRange = false;
+        for (uint32_t i = 0; i < filter->numPcRanges; i++) {
+            inRange |= (pc >= filter->pcLo[i]) & (pc < filter->pcHi[i]);
+        }
+        if (!inRange) {
+            return false;
+        }
+    }
+    if (filter->filterOps) {
+        int id = rv_opcode_id(inst);
+        if (id < 0 || !(filter->ops[id / 8] & (1 << (id % 8)))) {
+            return false;
+        }
+    }
+    if (filter->sampleRate > 1) {
+        bool take = (gate->sampleCount == 0);
+        gate->sampleCount = (gate->sampleCount + 1) % filter->sampleRate;
+        return take;
+    }
+    return true;
+}
+
+static bool rv_parse_u64(const char* str, const char* end, uint64_t* out) {
+    char buf[32];
+    size_t len = (size_t)(end - str);
+    if (len == 0 || len >= sizeof(buf)) {
+        return false;
+    }
+    memcpy(buf, str, len);
+    buf[len] = 0;
+    char* parsed = NULL;
+    *out = strtoull(buf, &parsed, 0);
+    return *parsed == 0;
+}
+
+// "lo:hi", half open
+static bool rv_parse_range(const char* str, const char* end, uint64_t* lo, uint64_t* hi) {
+    const char* colon = (const char*)memchr(str, ':', (size_t)(end - str));
+    return colon != NULL && rv_parse_u64(str, colon, lo) && rv_parse_u64(colon + 1, end, hi) && *lo < *hi;
+}
+
+// A raw word (exact match) or a mnemonic (any encoding of that op).
+static bool rv_parse_trigger(const char* str, const char* end, InstTrigger* trigger) {
+    uint64_t word;
+    if (rv_parse_u64(str, end, &word) && word <= 0xFFFFFFFF) {
+        trigger->mask = MASK_ALL;
+        trigger->match = (uint32_t)word;
+    } else {
+        const OpInfo* info = rv_find_op_by_name(str, (size_t)(end - str));
+        if (info == NULL) {
+            return false;
+        }
+        trigger->mask = info->searchMask;
+        trigger->match = info->searchVal;
+    }
+    trigger->enabled = true;
+    return true;
+}
+
+// Sets the trace filter from a spec of space separated key=value terms:
+//   pc=lo:hi         only pcs in [lo, hi); repeat for up to 8 ranges
+//   cycles=lo:hi     only cycles in [lo, hi)
+//   ops=name,name    only these mnemonics (at least one, all known)
+//   sample=N         keep every Nth inst that passes the rest
+//   start=X stop=X   trigger on a raw word or mnemonic
+// An empty spec traces everything. Returns 0 on success; on a parse error the
+// previous filter stays in place.
+DPI_DLLESPEC int rv_trace_set_filter(const char* spec) {
+    TraceFilter filter;
+    rv_trace_filter_init(&filter);
+
+    const char* p = (spec != NULL) ? spec : "";
+    while (*p) {
+        if (isspace((unsigned char)*p)) {
+            p++;
+            continue;
+        }
+        const char* termEnd = p;
+        while (*termEnd && !isspace((unsigned char)*termEnd)) {
+            termEnd++;
+        }
+        const char* eq = (const char*)memchr(p, '=', (size_t)(termEnd - p));
+        if (eq == NULL) {
+            return -1;
+        }
+        const char* val = eq + 1;
+        size_t keyLen = (size_t)(eq - p);
+        bool ok = false;
+
+        if (keyLen == 2 && strncmp(p, "pc", 2) == 0 && filter.numPcRanges < TRACE_MAX_PC_RANGES) {
+            ok = rv_parse_range(val, termEnd, &filter.pcLo[filter.numPcRanges], &filter.pcHi[filter.numPcRanges]);
+            filter.numPcRanges++;
+        } else if (keyLen == 6 && strncmp(p, "cycles", 6) == 0) {
+            ok = rv_parse_range(val, termEnd, &filter.cycleLo, &filter.cycleHi);
+        } else if (keyLen == 3 && strncmp(p, "ops", 3) == 0) {
+            // Every name must be a known op, so "ops=" or a stray comma is an
+            // error rather than a filter that never matches.
+            filter.filterOps = true;
+            ok = true;
+            for (const char* name = val; ok;) {
+                const char* nameEnd = (const char*)memchr(name, ',', (size_t)(termEnd - name));
+                nameEnd = (nameEnd != NULL) ? nameEnd : termEnd;
+                const OpInfo* info = rv_find_op_by_name(name, (size_t)(nameEnd - name));
+                if (info != NULL) {
+                    uint32_t id = (uint32_t)(info - UncompressedInsts);
+                    filter.ops[id / 8] |= 1 << (id % 8);
+                }
+                ok = (info != NULL);
+                if (nameEnd == termEnd) {
+                    break;
+                }
+                name = nameEnd + 1;
+            }
+        } else if (keyLen == 6 && strncmp(p, "sample", 6) == 0) {
+            uint64_t rate;
+            ok = rv_parse_u64(val, termEnd, &rate) && rate >= 1 && rate <= UINT32_MAX;
+            filter.sampleRate = ok ? (uint32_t)rate : 1;
+        } else if (keyLen == 5 && strncmp(p, "start", 5) == 0) {
+            ok = rv_parse_trigger(val, termEnd, &filter.start);
+        } else if (keyLen == 4 && strncmp(p, "stop", 4) == 0) {
+            ok = rv_parse_trigger(val, termEnd, &filter.stop);
+        }
+
+        if (!ok) {
+            return -1;
+        }
+        p = termEnd;
+    }
+
+    s_traceFilter = filter;
+    rv_trace_gate_init(&s_traceGate, &s_traceFilter);
+    return 0;
+}
+
+// Whether the filter lets this inst through. Advances trigger and sampling
+// state, so call it exactly once per retired inst.
+DPI_DLLESPEC char rv_trace_gate(unsigned long long cycle, unsigned long long pc, unsigned int inst) {
+    return rv_trace_gate_impl(&s_traceFilter, &s_traceGate, cycle, pc, inst);
+}
+
+static void rv_trace_harts_free(void);
+static void rv_trace_compact_flush(void);
+static void rv_trace_compact_reset(void);
+DPI_DLLESPEC void rv_trace_harts_flush(unsigned long long cycle);
+
+// Flushes anything still buffered per hart, then closes the text trace.
+// Hart producers must be quiet by now.
+DPI_DLLESPEC void rv_trace_close() {
+    rv_trace_harts_flush(UINT64_MAX);
+    rv_trace_harts_free();
+    rv_trace_compact_flush();
+    if (s_textTrace != NULL) {
+        fclose(s_textTrace);
+        s_textTrace = NULL;
+    }
+}
+
+// Starts a text trace at path, replacing any trace already open. Also
+// restarts the filter's trigger and sampling state. Returns 0 on success.
+DPI_DLLESPEC int rv_trace_open(const char* path) {
+    rv_trace_close();
+    s_textTrace = fopen(path, "w");
+    if (s_textTrace == NULL) {
+        return -1;
+    }
+    setvbuf(s_textTrace, NULL, _IOFBF, 1 << 20);
+    rv_trace_gate_init(&s_traceGate, &s_traceFilter);
+    rv_dataflow_reset_tables();
+    rv_trace_compact_reset();
+    return 0;
+}
+
+#define TRACE_DEPS_MAX 128
+
+static void rv_trace_write_line(uint64_t cycle, int hart, uint64_t pc, uint32_t inst, const char* deps) {
+    char* disass = rv_disass_impl(inst);
+    if (hart >= 0) {
+        fprintf(s_textTrace, "%10llu  hart%-3d  %016llx  %08x  %s%s\n",
+                (unsigned long long)cycle, hart, (unsigned long long)pc, inst, disass ? disass : "", deps);
+    } else {
+        fprintf(s_textTrace, "%10llu  %016llx  %08x  %s%s\n",
+                (unsigned long long)cycle, (unsigned long long)pc, inst, disass ? disass : "", deps);
+    }
+    free(disass);
+}
+
+static void rv_trace_emit(uint64_t cycle, int hart, uint64_t pc, uint32_t inst, const char* deps);
+
+// Gates, and only if the inst passes, disassembles it into the text trace.
+// Returns whether it was written.
+DPI_DLLESPEC char rv_trace_inst(unsigned long long cycle, unsigned long long pc, unsigned int inst) {
+    if (s_textTrace == NULL) {
+        return 0;
+    }
+    bool traced = rv_trace_gate_impl(&s_traceFilter, &s_traceGate, cycle, pc, inst);
+    char deps[TRACE_DEPS_MAX] = "";
+    if (s_dataflowEnabled) {
+        rv_dataflow_step(DF_SINGLE_HART, pc, inst, traced ? deps : NULL, sizeof(deps));
+    }
+    if (!traced) {
+        return 0;
+    }
+    rv_trace_emit(cycle, -1, pc, inst, deps);
+    return 1;
+}
+
+// =========================================
+// Loop compaction
+//
+// Long traces are mostly the same loop bodies over and over. With a window
+// set, each traced (pc, inst, hart) is looked up in a small table of where it
+// last appeared; a hit within the window makes that distance the candidate
+// body length. Following records are then compared against the record one
+// body back (pc, inst, hart and dataflow annotation; only cycles may differ),
+// held instead of written. Every full body that matches only bumps a
+// repeat count, so the disassembler runs on the first iteration alone. The
+// first mismatch writes one repeat line plus the held partial iteration and
+// goes back to writing normally.
+
+#define COMPACT_MAX_WINDOW 65536
+
+typedef struct {
+    uint64_t cycle;
+    uint64_t pc;
+    uint32_t inst;
+    int      hart;
+    char     deps[TRACE_DEPS_MAX];
+} CompactRecord;
+
+typedef struct {
+    uint64_t pc;
+    uint32_t inst;
+    int      hart;
+    uint64_t seq; // 0 if empty
+} CompactSeen;
+
+typedef struct {
+    uint32_t       window;   // 0 when off
+    CompactRecord* ring;     // Last window+1 records, by seq % (window+1)
+    CompactSeen*   seen;     // Direct-mapped, seenMask+1 entries
+    uint32_t       seenMask;
+    uint64_t       seq;      // Records seen so far
+    uint32_t       period;   // Candidate body length, 0 if not in a loop
+    uint32_t       held;     // Records of the current partial iteration
+    uint64_t       repeats;  // Full iterations matched
+} Compactor;
+
+static Compactor s_compact;
+
+static CompactRecord* rv_compact_at(uint64_t seq) {
+    return &s_compact.ring[seq % (s_compact.window + 1)];
+}
+
+// Writes the pending repeat line and the held partial iteration.
+static void rv_trace_compact_flush(void) {
+    Compactor* c = &s_compact;
+    if (c->period == 0) {
+        return;
+    }
+    if (s_textTrace != NULL) {
+        if (c->repeats > 0) {
+            fprintf(s_textTrace, "%10s  (previous %u inst%s repeated %llu more time%s)\n", "",
+                    c->period, (c->period == 1) ? "" : "s",
+                    (unsigned long long)c->repeats, (c->repeats == 1) ? "" : "s");
+        }
+        for (uint64_t seq = c->seq - c->held + 1; seq <= c->seq; seq++) {
+            const CompactRecord* rec = rv_compact_at(seq);
+            rv_trace_write_line(rec->cycle, rec->hart, rec->pc, rec->inst, rec->deps);
+        }
+    }
+    c->period = 0;
+    c->held = 0;
+    c->repeats = 0;
+}
+
+// Forgets earlier traces, so a new one doesn't start out inside their loops.
+static void rv_trace_compact_reset(void) {
+    rv_trace_compact_flush();
+    s_compact.seq = 0;
+    if (s_compact.seen != NULL) {
+        memset(s_compact.seen, 0, (s_compact.seenMask + 1) * sizeof(CompactSeen));
+    }
+}
+
+static void rv_trace_emit(uint64_t cycle, int hart, uint64_t pc, uint32_t inst, const char* deps) {
+    Compactor* c = &s_compact;
+    if (c->window == 0) {
+        rv_trace_write_line(cycle, hart, pc, inst, deps);
+        return;
+    }
+
+    if (c->period != 0) {
+        const CompactRecord* prev = rv_compact_at(c->seq + 1 - c->period);
+        if (prev->pc != pc || prev->inst != inst || prev->hart != hart ||
+            strcmp(prev->deps, deps) != 0) {
+            rv_trace_compact_flush();
+        }
+    }
+
+    uint64_t seq = ++c->seq;
+    CompactRecord* rec = rv_compact_at(seq);
+    rec->cycle = cycle;
+    rec->pc = pc;
+    rec->inst = inst;
+    rec->hart = hart;
+    snprintf(rec->deps, sizeof(rec->deps), "%s", deps);
+
+    uint32_t hash = (uint32_t)((pc >> 1) ^ (pc >> 13) ^ inst) ^ ((uint32_t)hart * 0x9e3779b9u);
+    CompactSeen* seen = &c->seen[hash & c->seenMask];
+    if (c->period == 0 && seen->seq != 0 && seen->pc == pc && seen->inst == inst && seen->hart == hart &&
+        seq - seen->seq <= c->window && strcmp(rv_compact_at(seen->seq)->deps, deps) == 0) {
+        c->period = (uint32_t)(seq - seen->seq);
+    }
+    seen->pc = pc;
+    seen->inst = inst;
+    seen->hart = hart;
+    seen->seq = seq;
+
+    if (c->period == 0) {
+        rv_trace_write_line(cycle, hart, pc, inst, deps);
+    } else if (++c->held == c->period) {
+        c->repeats++;
+        c->held = 0;
+    }
+}
+
+// Compacts repeated loop bodies of up to `window` insts in the text trace;
+// 0 turns it off. Anything pending is written out first. Returns 0 on
+// success, -1 if the window is too big or can't be allocated.
+DPI_DLLESPEC int rv_trace_set_compact(unsigned int window) {
+    if (window > COMPACT_MAX_WINDOW) {
+        return -1;
+    }
+    rv_trace_compact_flush();
+    free(s_compact.ring);
+    free(s_compact.seen);
+    memset(&s_compact, 0, sizeof(s_compact));
+    if (window == 0) {
+        return 0;
+    }
+
+    uint32_t seenSize = 64;
+    while (seenSize < 4 * window) {
+        seenSize *= 2;
+    }
+    s_compact.ring = (CompactRecord*)malloc((window + 1) * sizeof(CompactRecord));
+    s_compact.seen = (CompactSeen*)calloc(seenSize, sizeof(CompactSeen));
+    if (s_compact.ring == NULL || s_compact.seen == NULL) {
+        free(s_compact.ring);
+        free(s_compact.seen);
+        memset(&s_compact, 0, sizeof(s_compact));
+        return -1;
+    }
+    s_compact.window = window;
+    s_compact.seenMask = seenSize - 1;
+    return 0;
+}
+
+// =========================================
+// Multi-hart traces
+//
+// Each hart appends to its own chunked buffer with no locks: the hart is the
+// only writer of its tail chunk and the merge is the only reader/freer of its
+// head. rv_trace_harts_flush does a heap-based k-way merge by (cycle, hart) and
+// hands the ordered records to the gate, disassembler and writer in batches.
+// Adding harts only adds a heap entry to the merge; producers never touch
+// shared state.
+
+#define HART_CHUNK_RECORDS  4096
+#define HART_MERGE_BATCH    256
+
+typedef struct HartChunk {
+    struct HartChunk* next;  // Set by the producer once this chunk is full
+    uint32_t          count; // Records published so far
+    RvTraceRecord     records[HART_CHUNK_RECORDS];
+} HartChunk;
+
+typedef struct {
+    HartChunk* head;    // Merge side: oldest chunk not fully consumed
+    uint32_t   readIdx; // Merge side: next record in head
+    HartChunk* tail;    // Producer side: chunk being filled
+} HartStream;
+
+static HartStream* s_harts[TRACE_MAX_HARTS];
+
+static HartChunk* rv_hart_chunk_new(void) {
+    HartChunk* chunk = (HartChunk*)malloc(sizeof(HartChunk));
+    if (chunk != NULL) {
+        chunk->next = NULL;
+        chunk->count = 0;
+    }
+    return chunk;
+}
+
+// Appends one retired inst for hart. Safe to call concurrently for different
+// harts (one producer thread per hart), and concurrently with a flush.
+DPI_DLLESPEC void rv_trace_hart_inst(int hart, unsigned long long cycle, unsigned long long pc, unsigned int inst) {
+    if (hart < 0 || hart >= TRACE_MAX_HARTS) {
+        return;
+    }
+    HartStream* stream = __atomic_load_n(&s_harts[hart], __ATOMIC_ACQUIRE);
+    if (stream == NULL) {
+        stream = (HartStream*)malloc(sizeof(HartStream));
+        HartChunk* chunk = rv_hart_chunk_new();
+        if (stream == NULL || chunk == NULL) {
+            free(stream);
+            free(chunk);
+            return;
+        }
+        stream->head = chunk;
+        stream->readIdx = 0;
+        stream->tail = chunk;
+        __atomic_store_n(&s_harts[hart], stream, __ATOMIC_RELEASE);
+    }
+
+    HartChunk* tail = stream->tail;
+    if (tail->count == HART_CHUNK_RECORDS) {
+        HartChunk* chunk = rv_hart_chunk_new();
+        if (chunk == NULL) {
+            return;
+        }
+        __atomic_store_n(&tail->next, chunk, __ATOMIC_RELEASE);
+        stream->tail = chunk;
+        tail = chunk;
+    }
+
+    RvTraceRecord* rec = &tail->records[tail->count];
+    memset(rec, 0, sizeof(*rec));
+    rec->pc = pc;
+    rec->inst = inst;
+    rec->cycle = cycle;
+    rec->hart = (uint32_t)hart;
+    __atomic_store_n(&tail->count, tail->count + 1, __ATOMIC_RELEASE);
+}
+
+// Next unconsumed record of a hart, or NULL if it hasn't produced one yet.
+static const RvTraceRecord* rv_hart_peek(HartStream* stream) {
+    for (;;) {
+        HartChunk* head = stream->head;
+        uint32_t count = __atomic_load_n(&head->count, __ATOMIC_ACQUIRE);
+        if (stream->readIdx < count) {
+            return &head->records[stream->readIdx];
+        }
+        HartChunk* next = (count == HART_CHUNK_RECORDS) ? __atomic_load_n(&head->next, __ATOMIC_ACQUIRE) : NULL;
+        if (next == NULL) {
+            return NULL;
+        }
+        stream->head = next;
+        stream->readIdx = 0;
+        free(head);
+    }
+}
+
+typedef struct {
+    uint64_t cycle;
+    uint32_t hart;
+} HartHeapEntry;
+
+static bool rv_hart_heap_less(const HartHeapEntry* a, const HartHeapEntry* b) {
+    return (a->cycle < b->cycle) || (a->cycle == b->cycle && a->hart < b->hart);
+}
+
+static void rv_hart_heap_push(HartHeapEntry* heap, uint32_t* size, HartHeapEntry entry) {
+    uint32_t i = (*size)++;
+    while (i > 0 && rv_hart_heap_less(&entry, &heap[(i - 1) / 2])) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = entry;
+}
+
+static HartHeapEntry rv_hart_heap_pop(HartHeapEntry* heap, uint32_t* size) {
+    HartHeapEntry top = heap[0];
+    HartHeapEntry last = heap[--(*size)];
+    uint32_t i = 0;
+    for (;;) {
+        uint32_t child = 2 * i + 1;
+        if (child >= *size) {
+            break;
+        }
+        if (child + 1 < *size && rv_hart_heap_less(&heap[child + 1], &heap[child])) {
+            child++;
+        }
+        if (!rv_hart_heap_less(&heap[child], &last)) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return top;
+}
+
+static void rv_trace_write_batch(const RvTraceRecord* batch, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        const RvTraceRecord* rec = &batch[i];
+        bool traced = rv_trace_gate_impl(&s_traceFilter, &s_traceGate, rec->cycle, rec->pc, rec->inst);
+        char deps[TRACE_DEPS_MAX] = "";
+        if (s_dataflowEnabled) {
+            rv_dataflow_step(rec->hart, rec->pc, rec->inst, traced ? deps : NULL, sizeof(deps));
+        }
+        if (traced) {
+            rv_trace_emit(rec->cycle, (int)rec->hart, rec->pc, rec->inst, deps);
+        }
+    }
+}
+
+// Merges and writes every buffered record with a cycle before `cycle`. The
+// caller promises all harts have appended everything before that cycle;
+// call it once per clock or every few thousand cycles. Call from one thread.
+DPI_DLLESPEC void rv_trace_harts_flush(unsigned long long cycle) {
+    HartHeapEntry heap[TRACE_MAX_HARTS];
+    uint32_t heapSize = 0;
+    for (uint32_t h = 0; h < TRACE_MAX_HARTS; h++) {
+        HartStream* stream = __atomic_load_n(&s_harts[h], __ATOMIC_ACQUIRE);
+        const RvTraceRecord* rec = (stream != NULL) ? rv_hart_peek(stream) : NULL;
+        if (rec != NULL && rec->cycle < cycle) {
+            HartHeapEntry entry = {rec->cycle, h};
+            rv_hart_heap_push(heap, &heapSize, entry);
+        }
+    }
+
+    RvTraceRecord batch[HART_MERGE_BATCH];
+    uint32_t batchSize = 0;
+    while (heapSize > 0) {
+        HartHeapEntry top = rv_hart_heap_pop(heap, &heapSize);
+        HartStream* stream = s_harts[top.hart];
+        batch[batchSize++] = *rv_hart_peek(stream);
+        stream->readIdx++;
+        if (batchSize == HART_MERGE_BATCH) {
+            if (s_textTrace != NULL) {
+                rv_trace_write_batch(batch, batchSize);
+            }
+            batchSize = 0;
+        }
+
+        const RvTraceRecord* next = rv_hart_peek(stream);
+        if (next != NULL && next->cycle < cycle) {
+            HartHeapEntry entry = {next->cycle, top.hart};
+            rv_hart_heap_push(heap, &heapSize, entry);
+        }
+    }
+    if (s_textTrace != NULL) {
+        rv_trace_write_batch(batch, batchSize);
+    }
+}
+
+static void rv_trace_harts_free(void) {
+    for (uint32_t h = 0; h < TRACE_MAX_HARTS; h++) {
+        HartStream* stream = s_harts[h];
+        if (stream == NULL) {
+            continue;
+        }
+        HartChunk* chunk = stream->head;
+        while (chunk != NULL) {
+            HartChunk* next = chunk->next;
+            free(chunk);
+            chunk = next;
+        }
+        free(stream);
+        s_harts[h] = NULL;
+    }
+}
+
 #ifdef __cplusplus
 } // extern C
 #endif
\ No newline at end of file
@@ -4,6 +4,9 @@
 #ifndef RV_DISASS_DPI
 #define RV_DISASS_DPI
 
+#include <stddef.h>
+#include <stdint.h>
+
 #ifndef DPI_DLLISPEC
 #ifdef _WIN32
 #define DPI_DLLISPEC __declspec(dllimport)
@@ -16,10 +19,97 @@
 extern "C" {
 #endif
 
+// Raw retire trace records, as written by rv_rawtrace_put and read by the
+// trace tools. A file is an RvTraceHeader followed by packed records. The
+// layout is fixed; rv_disass.c and tests/raw_traces.cpp check it.
+#define RV_TRACE_MAGIC   0x52545652 // "RVTR"
+#define RV_TRACE_VERSION 1
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t recordSize;
+    uint64_t reserved;
+} RvTraceHeader;
+
+typedef struct {
+    // Architectural state: what lockstep comparison looks at.
+    uint64_t pc;
+    uint64_t rdValue;
+    uint32_t inst;
+    uint8_t  rd;          // Destination register written, 0 if none
+    uint8_t  reserved[3];
+    // Bookkeeping: differs between a core and its reference model.
+    uint64_t cycle;
+    uint32_t hart;
+    uint32_t flags;
+} RvTraceRecord;
+
+#define RV_TRACE_COMPARED_BYTES 24 // pc, rdValue, inst, rd
+
 DPI_DLLISPEC char* rv_disass(unsigned int inst);
 DPI_DLLISPEC void rv_free(char* str);
 DPI_DLLISPEC void rv_set_option(const char* str, char enabled);
 DPI_DLLISPEC void rv_reset_options();
+DPI_DLLISPEC int rv_opcode_id(unsigned int inst);
+DPI_DLLISPEC int rv_opcode_id_by_name(const char* name);
+DPI_DLLISPEC int rv_opcode_count();
+DPI_DLLISPEC const char* rv_opcode_name(int id);
+DPI_DLLISPEC int rv_opcode_pattern(int id, unsigned int* match, unsigned int* mask);
+DPI_DLLISPEC int rv_decode_fields(unsigned int inst, int* rd, int* rs1, int* rs2, int* csr);
+DPI_DLLISPEC const char* rv_reg_name(unsigned int reg);
+DPI_DLLISPEC int rv_reg_by_name(const char* name);
+
+// Raw fetch data: little-endian 16-bit parcels, compressed and not. C only,
+// since DPI can't pass callbacks; text is freed once fn returns. rv_disass.c
+// has its own copy of RvParcelInst and asserts this layout.
+typedef struct {
+    uint64_t    addr;
+    uint32_t    length; // In bytes
+    uint32_t    inst;   // First 4 bytes, or the one parcel for compressed insts
+    const char* text;
+} RvParcelInst;
+
+typedef int (*RvParcelFn)(void* ctx, const RvParcelInst* inst);
+
+// Calls fn on each whole inst in bytes until it returns nonzero. Returns the
+// bytes consumed (a trailing partial inst isn't), or RV_PARCELS_FAILED if
+// memory ran out partway; insts before that have already gone to fn.
+#define RV_PARCELS_FAILED ((size_t)-1)
+DPI_DLLISPEC size_t rv_disass_parcels(const void* bytes, size_t size, unsigned long long addr,
+                                      RvParcelFn fn, void* ctx);
+
+// Pre-rendered ROM images
+DPI_DLLISPEC int rv_rom_prerender(const char* image, unsigned int base, char isBinary, const char* sidecar);
+DPI_DLLISPEC int rv_rom_load(const char* sidecar);
+DPI_DLLISPEC void rv_rom_unload_all();
+DPI_DLLISPEC char* rv_disass_at(unsigned int pc, unsigned int inst);
+
+// Raw retire traces
+DPI_DLLISPEC int rv_rawtrace_open(const char* path);
+DPI_DLLISPEC void rv_rawtrace_put(int hart, unsigned long long cycle, unsigned long long pc,
+                                  unsigned int inst, unsigned char rd, unsigned long long rdValue);
+DPI_DLLISPEC void rv_rawtrace_close();
+
+// Functional coverage of instruction encodings
+DPI_DLLISPEC void rv_cov_sample(unsigned int inst);
+DPI_DLLISPEC void rv_cov_reset();
+DPI_DLLISPEC int rv_cov_bins_hit();
+DPI_DLLISPEC int rv_cov_bins_total();
+DPI_DLLISPEC int rv_cov_report(const char* path);
+
+// Gated text traces
+DPI_DLLISPEC int rv_trace_set_filter(const char* spec);
+DPI_DLLISPEC char rv_trace_gate(unsigned long long cycle, unsigned long long pc, unsigned int inst);
+DPI_DLLISPEC int rv_trace_open(const char* path);
+DPI_DLLISPEC char rv_trace_inst(unsigned long long cycle, unsigned long long pc, unsigned int inst);
+DPI_DLLISPEC void rv_trace_close();
+DPI_DLLISPEC void rv_trace_hart_inst(int hart, unsigned long long cycle, unsigned long long pc, unsigned int inst);
+DPI_DLLISPEC void rv_trace_harts_flush(unsigned long long cycle);
+DPI_DLLISPEC void rv_trace_set_dataflow(char enabled);
+DPI_DLLISPEC unsigned long long rv_trace_dataflow_hist(int distance);
+DPI_DLLISPEC int rv_trace_dataflow_report(const char* path);
+DPI_DLLISPEC int rv_trace_set_compact(unsigned int window);
 
 #ifdef __cplusplus
 } // extern "C"
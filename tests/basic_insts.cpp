@@ -1,6 +1,8 @@
 #include "gtest/gtest.h"
 #include "test_common.h"
 
+#include <tuple>
+
 #define ASSERT_DISASS(inst, disass) \
     ASSERT_EQ(rv_disass_str(inst), disass)
 
@@ -33,6 +35,44 @@ TEST(Rv32Basic, Csrs) {
     ASSERT_DISASS(0xC0002073, "csrrs   zero, mcycle, zero");
 }
 
+TEST(Rv32Basic, LlvmStyle) {
+    rv_reset_options();
+    rv_set_option("LlvmStyle", true);
+    ASSERT_DISASS(0xFFF00093, "\taddi\tra, zero, -1");
+    ASSERT_DISASS(0x00000073, "\tecall\t");
+    ASSERT_DISASS(0x0840000f, "\tfence\ti, o");
+    ASSERT_DISASS(0x00001001, "unknown");
+    rv_set_option("UsePseudoInsts", true);
+    ASSERT_DISASS(0x00000013, "\tnop");
+    ASSERT_DISASS(0xFFF00093, "\tli\tra, -1");
+    ASSERT_DISASS(0x8330000f, "\tfence.tso\t");
+}
+
+TEST(Rv32Basic, OpcodeId) {
+    rv_reset_options();
+    ASSERT_EQ(rv_opcode_id(0x00000093), rv_opcode_id(0xFFF00093));
+    ASSERT_STREQ(UncompressedInsts[rv_opcode_id(0x00000093)].name, "addi");
+    ASSERT_EQ(rv_opcode_id(0x00001001), -1);
+    ASSERT_EQ(rv_opcode_id_by_name("addi"), rv_opcode_id(0x00000093));
+    ASSERT_EQ(rv_opcode_id_by_name("addiw"), rv_opcode_id(0x0000009b));
+    ASSERT_EQ(rv_opcode_id_by_name("add."), -1);
+}
+
+TEST(Rv32Basic, DecodeFields) {
+    int rd, rs1, rs2, csr;
+    // add a0, a1, a2
+    ASSERT_EQ(rv_decode_fields(0x00c58533, &rd, &rs1, &rs2, &csr), rv_opcode_id_by_name("add"));
+    EXPECT_EQ(std::make_tuple(rd, rs1, rs2, csr), std::make_tuple(10, 11, 12, -1));
+    // sw a0, 8(sp)
+    ASSERT_EQ(rv_decode_fields(0x00a12423, &rd, &rs1, &rs2, &csr), rv_opcode_id_by_name("sw"));
+    EXPECT_EQ(std::make_tuple(rd, rs1, rs2, csr), std::make_tuple(-1, 2, 10, -1));
+    // csrrwi t0, mstatus, 5: the rs1 slot is an immediate
+    ASSERT_EQ(rv_decode_fields(0x3002d2f3, &rd, &rs1, &rs2, &csr), rv_opcode_id_by_name("csrrwi"));
+    EXPECT_EQ(std::make_tuple(rd, rs1, rs2, csr), std::make_tuple(5, -1, -1, 0x300));
+    ASSERT_EQ(rv_decode_fields(0x00001001, &rd, &rs1, &rs2, &csr), -1);
+    EXPECT_EQ(std::make_tuple(rd, rs1, rs2, csr), std::make_tuple(-1, -1, -1, -1));
+}
+
 TEST(Rv32Basic, Special) {
     rv_reset_options();
     // ASSERT_DISASS(0x10500073, "wfi");
@@ -0,0 +1,58 @@
+#include "gtest/gtest.h"
+#include "test_common.h"
+
+#include <fstream>
+#include <sstream>
+
+std::string ReportText() {
+    std::string path = ::testing::TempDir() + "rv_cov_report.txt";
+    EXPECT_EQ(rv_cov_report(path.c_str()), 0);
+    std::ifstream in(path);
+    std::stringstream text;
+    text << in.rdbuf();
+    std::remove(path.c_str());
+    return text.str();
+}
+
+TEST(Coverage, Empty) {
+    rv_cov_reset();
+    EXPECT_EQ(rv_cov_bins_hit(), 0);
+    EXPECT_GT(rv_cov_bins_total(), 0);
+}
+
+TEST(Coverage, Bins) {
+    rv_cov_reset();
+    rv_cov_sample(0x00000013); // nop: op, rd zero, rs1 zero, imm 0, pseudo nop
+    EXPECT_EQ(rv_cov_bins_hit(), 5);
+
+    rv_cov_sample(0x00000013); // Same bins again
+    EXPECT_EQ(rv_cov_bins_hit(), 5);
+
+    rv_cov_sample(0x7ff00093); // addi ra, zero, 2047: rd ra, imm max, pseudo li
+    EXPECT_EQ(rv_cov_bins_hit(), 8);
+
+    rv_cov_sample(0x80000093); // addi ra, zero, -2048: imm min
+    EXPECT_EQ(rv_cov_bins_hit(), 9);
+
+    rv_cov_sample(0x00001001); // Unknown words don't hit bins
+    EXPECT_EQ(rv_cov_bins_hit(), 9);
+
+    std::string report = ReportText();
+    EXPECT_NE(report.find("9/"), std::string::npos);
+    EXPECT_NE(report.find("1 unknown"), std::string::npos);
+    EXPECT_NE(report.find("imm:-1"), std::string::npos);
+    EXPECT_NE(report.find("pseudo:mv"), std::string::npos);
+}
+
+TEST(Coverage, ShiftAmountRange) {
+    rv_cov_reset();
+    rv_cov_sample(0x01f0909b); // slliw ra, ra, 31: max for the W form
+    rv_cov_sample(0x03f09093); // slli ra, ra, 63: max for RV64
+    std::string report = ReportText();
+    EXPECT_EQ(report.find("imm:max"), std::string::npos) << report;
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,9 +1,9 @@
 #include "gtest/gtest.h"
 #include "test_common.h"
+#include "rv_parallel.h"
 
-#include <atomic>
-#include <deque>
-#include <thread>
+#include <cstring>
+#include <vector>
 
 #include <llvm-c/Disassembler.h>
 #include <llvm-c/Target.h>
@@ -11,90 +11,48 @@
 constexpr uint64_t FullRangeStart = 0;
 constexpr uint64_t FullRangeEnd   = 0x100000000;
 
-class ExhaustiveThreadPool {
-public:
-    ExhaustiveThreadPool(uint64_t start, uint64_t end /* exclusive */, uint64_t numThreads=0)
-     : m_min(start),
-       m_max(end),
-       m_numThreads(numThreads),
-       m_chunksStarted(0),
-       m_chunksDone(0),
-       m_valid(true)
-    {
-        if (m_numThreads == 0) 
-        {
-            m_numThreads = std::thread::hardware_concurrency();
+// Runs fn on every index in [start, end) across all CPUs, stopping at the
+// first failure. In the future, we might make output more thread friendly but
+// not today.
+template <typename F>
+void RunExhaustive(uint64_t start, uint64_t end /* exclusive */, F fn) {
+    struct Run {
+        F*    fn;
+        float percentDone;
+    } run = {&fn, 0.0f};
+
+    RvParallelOpts opts;
+    rv_parallel_opts_init(&opts);
+    opts.pinThreads = true;
+    opts.ctx = &run;
+    opts.progress = [](void* ctx, uint64_t chunksDone, uint64_t numChunks) {
+        Run* run = static_cast<Run*>(ctx);
+        float newPercentDone = static_cast<float>(chunksDone) * 100 / numChunks;
+        if (newPercentDone - run->percentDone > 1.0) {
+            printf("...%2.1f%%\n", newPercentDone);
+            run->percentDone = newPercentDone; // Only store printed percent, that's what user cares about.
         }
-
-        m_chunkSize = 8192; // Better heuristic probably needed. This makes sense for per-inst tests.
-        m_numChunks = (m_max + m_chunkSize - 1 - m_min)  / m_chunkSize; // Divide, rounding up.
-    }
-
-    template <typename F>
-    void run(F fn) {
-        assert(m_chunksStarted == 0);
-        for (uint32_t i = 0; i < m_numThreads; i++) {
-            m_activeThreads.push_back(std::thread(&ExhaustiveThreadPool::worker<F>, this, fn));
-        }
-
-        float percentDone = 0.0;
-        while (m_valid && m_chunksDone < m_numChunks) {
-            float newPercentDone = static_cast<float>(m_chunksDone) * 100 / m_numChunks;
-            if (newPercentDone - percentDone > 1.0) {
-                printf("...%2.1f%%\n", newPercentDone);
-                percentDone = newPercentDone; // Only store printed percent, that's what user cares about.
-            }
-        }
-
-        for (auto& activeThread : m_activeThreads) {
-            activeThread.join();
-        }
-    }
-private:
-    template <typename F>
-    void worker(F fn) {
-        while (m_valid) {
-            uint64_t chunkIdx = m_chunksStarted.fetch_add(1);
-            if (chunkIdx >= m_numChunks)
-            {
-                return;
-            }
-            uint64_t chunkMin = m_min + (chunkIdx * m_chunkSize);
-            uint64_t chunkMax = std::min(m_min + ((chunkIdx + 1) * m_chunkSize), m_max);
-            for (uint64_t trial = chunkMin; trial < chunkMax; trial++)
-            {
-                EXPECT_NO_THROW({
-                    fn(trial);
-                });
-                if (testing::Test::HasFailure()) {
-                    // In the future, we might make output more thread friendly but not today.
-                    m_valid = false;
-                }
-                if (m_valid == false) {
-                    return;
-                }
+    };
+    // A pool that fails to start checks nothing, so that's a failure too.
+    int result = rv_parallel_run(start, end, &opts, [](void* ctx, uint64_t begin, uint64_t end, RvParallelOut*) {
+        Run* run = static_cast<Run*>(ctx);
+        for (uint64_t trial = begin; trial < end; trial++) {
+            EXPECT_NO_THROW({
+                (*run->fn)(trial);
+            });
+            if (testing::Test::HasFailure()) {
+                return 1;
             }
-            m_chunksDone++;
         }
-    }
-
-
-    uint64_t m_min;
-    uint64_t m_max;
-    uint64_t m_numChunks;
-    uint64_t m_numThreads;
-    uint64_t m_chunkSize;
-    std::deque<std::thread> m_activeThreads;
-    std::atomic_uint64_t m_chunksStarted;
-    std::atomic_uint64_t m_chunksDone;
-    std::atomic_bool m_valid;
-};
+        return 0;
+    });
+    ASSERT_EQ(result, 0) << "a check failed, or the pool couldn't start";
+}
 
 
 TEST(LiterallyEverything, DISABLED_DontCrash)
 {
-    ExhaustiveThreadPool threads(FullRangeStart, FullRangeEnd);
-    threads.run([] (uint64_t inst) {
+    RunExhaustive(FullRangeStart, FullRangeEnd, [] (uint64_t inst) {
         char* str = rv_disass(inst);
         rv_free(str);
     });
@@ -118,62 +76,56 @@ LLVMDisasmContextRef GetLlvmDisassembler() {
     return ref;
 }
 
-std::string GetDisassFromLlvm(LLVMDisasmContextRef dis, uint32_t inst) {
-    char buffer[128] = {0};
-    LLVMDisasmInstruction(dis, reinterpret_cast<uint8_t*>(&inst), sizeof(inst), 0,
-                          buffer, sizeof(buffer));
-
-    return std::string(buffer);
+// Writes LLVM's text into buffer, or "unknown" if it can't decode the word.
+void GetDisassFromLlvm(LLVMDisasmContextRef dis, uint32_t inst, char* buffer, size_t size) {
+    size_t len = LLVMDisasmInstruction(dis, reinterpret_cast<uint8_t*>(&inst), sizeof(inst), 0,
+                                       buffer, size);
+    if (len == 0) {
+        snprintf(buffer, size, "unknown");
+    }
 }
 
-// Strips preceding, trailing, and interior whitespace of 2+ chars
-std::string normalize_ws(std::string input) {
-    std::string out;
-    out.reserve(input.size());
-    bool wasspace = false;
-    bool wasstart = true;
-    for (char& c : input) {
-        if (isspace(c)) {
-            wasspace = true;
-            continue;
-        }
-        if (wasspace && !wasstart) {
-            out += ' ';
+// Ops we decode but print differently on purpose, by opcode ID.
+// CSR accesses: LLVM has a pile of aliases (csrr, rdcycle, frrm...) we don't.
+std::vector<bool> GetSkippedOps() {
+    const char* skipped[] = {
+        "csrrw", "csrrs", "csrrc", "csrrwi", "csrrsi", "csrrci",
+    };
+    std::vector<bool> out(UncompressedInstsSize, false);
+    for (uint32_t i = 0; i < UncompressedInstsSize; i++) {
+        for (const char* name : skipped) {
+            if (strcmp(UncompressedInsts[i].name, name) == 0) {
+                out[i] = true;
+            }
         }
-        wasspace = false;
-        wasstart = false;
-        out += c;
     }
     return out;
 }
 
-
-bool ShouldSkip(const std::string& llvms) {
-    std::string blacklist[] = {
-        // Any 64 bit insts
-
-        // Unimplemented exts
+// Mnemonics LLVM knows that we don't decode yet. Only consulted for words
+// we call unknown, which keeps the lookup off the common path.
+bool IsUnimplementedInLlvm(const char* llvms) {
+    static const char* unimplemented[] = {
         "fence.i",
-        "csr",
+        "fmv.x.w",
+        "fmv.w.x",
         "unimp", // It's literally an inst that is defined to not be implemented
         "uret",
         "sret",
         "dret",
         "mret",
         "wfi",
-        "rdinstret",
-        "rdcycle",
-        "rdtime",
-        "frrm",
-        "fsrm",
-        "frflags",
-        "fsflags",
 
         // I'm dealing with you later
-        "sfence",
+        "sfence.vma",
     };
-    for (const auto& tv : blacklist) {
-        if (llvms.find(tv) != std::string::npos) {
+    // LLVM output is "\t<mnemonic>\t<operands>"
+    if (*llvms == '\t') {
+        llvms++;
+    }
+    size_t len = strcspn(llvms, "\t");
+    for (const char* name : unimplemented) {
+        if (strlen(name) == len && strncmp(llvms, name, len) == 0) {
             return true;
         }
     }
@@ -190,35 +142,63 @@ uint32_t get_start_point() {
 
 TEST(LiterallyEverything, CompareToLlvm) {
     LLVMDisasmContextRef dis = GetLlvmDisassembler();
+    const std::vector<bool> skippedOps = GetSkippedOps();
     rv_set_option("UsePseudoInsts", true);
-    ExhaustiveThreadPool threads(get_start_point(), FullRangeEnd);
-    threads.run([&](uint64_t inst) {
-        std::string rv_inst = normalize_ws(rv_disass_str(inst));
-        std::string llvm_inst = normalize_ws(GetDisassFromLlvm(dis, inst));
-
-        if (llvm_inst == "") {
-            llvm_inst = "unknown";
+    rv_set_option("LlvmStyle", true);
+    RunExhaustive(get_start_point(), FullRangeEnd, [&](uint64_t inst) {
+        int id = rv_opcode_id(inst);
+        if (id >= 0 && skippedOps[id]) {
+            return;
         }
 
-        if (!ShouldSkip(llvm_inst) && rv_inst != llvm_inst) {
-            ASSERT_EQ(rv_inst, llvm_inst) << "when disassembling " << inst;
+        // SimDoesCopy is on, so the library owns this until our next call.
+        const char* rv_inst = rv_disass(inst);
+        char llvm_inst[128];
+        GetDisassFromLlvm(dis, inst, llvm_inst, sizeof(llvm_inst));
+
+        if (strcmp(rv_inst, llvm_inst) != 0 && !(id < 0 && IsUnimplementedInLlvm(llvm_inst))) {
+            ASSERT_STREQ(rv_inst, llvm_inst) << "when disassembling " << inst;
         }
     });
 }
 
-TEST(LiterallyEverything, DISABLED_NoOverlap) {
-    ExhaustiveThreadPool threads(FullRangeStart, FullRangeEnd);
-    threads.run([&](uint64_t inst) {
-        int matches = 0;
-        for (uint32_t info_idx = 0; info_idx < UncompressedInstsSize; info_idx++) {
-            const OpInfo* info = &UncompressedInsts[info_idx];
-            if ((inst & info->searchMask) == info->searchVal) {
-                matches += 1;
-            }
+// Every 16-bit parcel, through the parcel stream path. LLVM prints compressed
+// insts expanded by default, which is what we print too.
+TEST(LiterallyEverything, CompressedCompareToLlvm) {
+    GetLlvmDisassembler(); // For the target init
+    LLVMDisasmContextRef dis = LLVMCreateDisasmCPUFeatures("riscv64", "", "+c", NULL, 0, NULL, NULL);
+    ASSERT_NE(dis, nullptr);
+    rv_set_option("UsePseudoInsts", true);
+    rv_set_option("LlvmStyle", true);
+    for (uint32_t parcel = 0; parcel < 0x10000; parcel++) {
+        if ((parcel & 0x3) == 0x3) {
+            continue;
         }
-
-        ASSERT_LT(matches, 2) << "Instruction " << inst << " matches more than one op!";
-    });
+        uint8_t bytes[2] = {static_cast<uint8_t>(parcel), static_cast<uint8_t>(parcel >> 8)};
+        std::string rv_inst;
+        size_t used = rv_disass_parcels(bytes, sizeof(bytes), 0, [](void* ctx, const RvParcelInst* inst) {
+            *static_cast<std::string*>(ctx) = inst->text;
+            return 0;
+        }, &rv_inst);
+        ASSERT_EQ(used, 2u);
+
+        char llvm_inst[128];
+        size_t len = LLVMDisasmInstruction(dis, bytes, sizeof(bytes), 0, llvm_inst, sizeof(llvm_inst));
+        if (len != 2) {
+            snprintf(llvm_inst, sizeof(llvm_inst), "unknown");
+        }
+        // LLVM leaves HINTs (rd = x0, shamt = 0) compressed since they don't
+        // round trip, and takes c.lui with a zero imm, which is reserved.
+        bool llvmHint = strncmp(llvm_inst, "\tc.", 3) == 0;
+        bool reservedLui = (parcel & 0xE003) == 0x6001 && (parcel & 0x107C) == 0;
+        if (rv_inst == "unknown" && (IsUnimplementedInLlvm(llvm_inst) || reservedLui)) {
+            continue;
+        }
+        if (!(llvmHint && rv_inst != "unknown")) {
+            ASSERT_EQ(rv_inst, llvm_inst) << "when disassembling parcel " << parcel;
+        }
+    }
+    LLVMDisasmDispose(dis);
 }
 
 int main(int argc, char **argv) {
@@ -0,0 +1,53 @@
+`include "rv_disass.svi"
+
+// Retires one instruction from a looping ROM every cycle and pushes it through
+// whichever disassembly path `mode` selects. Driven by verilator/bench_main.cpp.
+module disass_bench(
+    input  logic        clk,
+    input  logic [2:0]  mode,
+    output logic [31:0] sink
+);
+
+localparam int ROM_WORDS = 1024;
+localparam int unsigned BASE = 32'h80000000;
+
+localparam logic [2:0] MODE_OFF        = 0; // No DPI at all
+localparam logic [2:0] MODE_PER_CALL   = 1; // rv_disass every cycle
+localparam logic [2:0] MODE_PRERENDER  = 2; // rv_disass_at on a pre-rendered ROM
+localparam logic [2:0] MODE_TRACE      = 3; // rv_trace_inst, every inst written
+localparam logic [2:0] MODE_TRACE_GATE = 4; // rv_trace_inst, filter set by the driver
+localparam logic [2:0] MODE_HARTS      = 5; // rv_trace_hart_inst, merged in batches
+localparam logic [2:0] MODE_RAW        = 6; // rv_rawtrace_put, disassembled offline
+
+logic [31:0] rom [0:ROM_WORDS-1];
+logic [9:0] idx = 0;
+longint unsigned cycle = 0;
+
+initial $readmemh("disass_bench.hex", rom);
+
+always @(posedge clk) begin
+    automatic int unsigned pc = BASE + {20'b0, idx, 2'b0};
+    automatic logic [31:0] inst = rom[idx];
+    automatic string s;
+    case (mode)
+        MODE_OFF:        sink <= sink ^ inst;
+        MODE_PER_CALL:   begin s = rv_disass(inst); sink <= sink + s.len(); end
+        MODE_PRERENDER:  begin s = rv_disass_at(pc, inst); sink <= sink + s.len(); end
+        MODE_TRACE,
+        MODE_TRACE_GATE: sink <= sink + {31'b0, rv_trace_inst(cycle, {32'b0, pc}, inst) != 0};
+        MODE_HARTS: begin
+            rv_trace_hart_inst(0, cycle, {32'b0, pc}, inst);
+            if (cycle[11:0] == 0) rv_trace_harts_flush(cycle);
+            sink <= sink ^ inst;
+        end
+        MODE_RAW: begin
+            rv_rawtrace_put(0, cycle, {32'b0, pc}, inst, 8'(inst[11:7]), cycle);
+            sink <= sink ^ inst;
+        end
+        default:         sink <= sink ^ inst;
+    endcase
+    idx <= idx + 10'd1;
+    cycle <= cycle + 64'd1;
+end
+
+endmodule
@@ -0,0 +1,18 @@
+#!/bin/bash
+# Usage: bench.sh [cycles per mode]
+
+TESTDIR=$(realpath $(dirname -- "$BASH_SOURCE[0]"))
+WORKDIR=$TESTDIR/workdir/bench
+ROOT=$TESTDIR/../../..
+
+DESIGN_NAME=disass_bench
+
+mkdir -p $WORKDIR
+cd $WORKDIR
+
+verilator -Wall -O3 --cc --exe $ROOT/src/rv_disass.c $TESTDIR/bench_main.cpp \
+    -CFLAGS "-O2 -I$ROOT/src" +incdir+$ROOT/src $TESTDIR/../$DESIGN_NAME.sv
+make -C $WORKDIR/obj_dir -f V$DESIGN_NAME.mk
+obj_dir/V$DESIGN_NAME "$@" | tee bench_report.txt
+
+echo
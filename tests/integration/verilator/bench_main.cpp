@@ -0,0 +1,127 @@
+#include "Vdisass_bench.h"
+#include "verilated.h"
+#include "rv_disass.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+// Sizes DPI disassembly overhead: runs disass_bench.sv once per mode and
+// reports simulated cycles per wall-clock second against the no-DPI baseline.
+
+static const unsigned RomWords = 1024;
+static const unsigned RomBase = 0x80000000;
+
+struct Mode {
+    unsigned char id;
+    const char* name;
+    const char* description;
+};
+
+static const Mode Modes[] = {
+    {0, "off",        "no disassembly"},
+    {1, "per-call",   "rv_disass every cycle"},
+    {2, "prerender",  "rv_disass_at, pre-rendered ROM"},
+    {3, "trace",      "rv_trace_inst, ungated"},
+    {4, "trace-gate", "rv_trace_inst, sample=64"},
+    {5, "harts",      "rv_trace_hart_inst, batched merge"},
+    {6, "raw",        "rv_rawtrace_put, no disassembly"},
+};
+
+// A loop body that looks like compiled code: mostly ALU/load/store/branch,
+// with random registers and immediates and the odd system/CSR/illegal word.
+static void WriteRom(const char* path) {
+    static const unsigned Majors[] = {0x13, 0x13, 0x13, 0x33, 0x33, 0x03, 0x03, 0x23,
+                                      0x63, 0x63, 0x37, 0x17, 0x6f, 0x67, 0x73, 0x0f};
+    std::mt19937 rng(1234);
+    FILE* f = fopen(path, "w");
+    if (f == NULL) {
+        perror(path);
+        exit(2);
+    }
+    for (unsigned i = 0; i < RomWords; i++) {
+        unsigned inst = (rng() & ~0x7fu) | Majors[rng() % 16];
+        if ((inst & 0x7f) == 0x33) {
+            inst &= ~0xbe000000u; // funct7 of 0x00 or 0x20
+        }
+        fprintf(f, "%08x\n", inst);
+    }
+    fclose(f);
+}
+
+static void Setup(unsigned char mode) {
+    rv_reset_options();
+    switch (mode) {
+    case 2:
+        if (rv_rom_prerender("disass_bench.hex", RomBase, 0, "disass_bench.rvrom") != 0 ||
+            rv_rom_load("disass_bench.rvrom") != 0) {
+            fprintf(stderr, "Couldn't pre-render the bench ROM\n");
+            exit(2);
+        }
+        break;
+    case 3:
+    case 4:
+    case 5:
+        rv_trace_set_filter(mode == 4 ? "sample=64" : "");
+        rv_trace_open("disass_bench.trace");
+        break;
+    case 6:
+        rv_rawtrace_open("disass_bench.rvt");
+        break;
+    }
+}
+
+static void Teardown(unsigned char mode) {
+    switch (mode) {
+    case 2:
+        rv_rom_unload_all();
+        break;
+    case 3:
+    case 4:
+    case 5:
+        rv_trace_close();
+        break;
+    case 6:
+        rv_rawtrace_close();
+        break;
+    }
+}
+
+int main(int argc, char** argv, char** env) {
+    (void)env;
+    Verilated::commandArgs(argc, argv);
+    unsigned long long cycles = (argc > 1 && argv[1][0] != '+') ? strtoull(argv[1], NULL, 0) : 1000000;
+
+    WriteRom("disass_bench.hex");
+
+    printf("%-11s %-34s %12s %10s %14s %9s\n", "mode", "path", "cycles", "seconds", "cycles/sec", "slowdown");
+    double baseline = 0;
+    for (const Mode& mode : Modes) {
+        Setup(mode.id);
+        Vdisass_bench* top = new Vdisass_bench{};
+        top->mode = mode.id;
+        top->clk = 0;
+        top->eval();
+
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned long long c = 0; c < cycles; c++) {
+            top->clk = 1;
+            top->eval();
+            top->clk = 0;
+            top->eval();
+        }
+        // Closing flushes buffered output, which is part of the cost.
+        Teardown(mode.id);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        delete top;
+
+        double rate = cycles / seconds;
+        if (mode.id == 0) {
+            baseline = rate;
+        }
+        printf("%-11s %-34s %12llu %10.3f %14.0f %8.2fx\n", mode.name, mode.description, cycles, seconds, rate,
+               baseline / rate);
+    }
+    return 0;
+}
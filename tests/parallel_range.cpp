@@ -0,0 +1,162 @@
+#include "gtest/gtest.h"
+#include "rv_parallel.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Visits {
+    std::vector<std::atomic<uint8_t>> counts;
+    explicit Visits(size_t n) : counts(n) {}
+};
+
+static int CountVisits(void* ctx, uint64_t begin, uint64_t end, RvParallelOut* out) {
+    EXPECT_EQ(out, nullptr);
+    Visits* visits = static_cast<Visits*>(ctx);
+    for (uint64_t i = begin; i < end; i++) {
+        visits->counts[i]++;
+    }
+    return 0;
+}
+
+TEST(ParallelRange, VisitsEachIndexOnce) {
+    for (unsigned threads : {1, 3, 8}) {
+        Visits visits(100003);
+        RvParallelOpts opts;
+        rv_parallel_opts_init(&opts);
+        opts.numThreads = threads;
+        opts.chunkSize = 97;
+        opts.ctx = &visits;
+        ASSERT_EQ(rv_parallel_run(5, visits.counts.size(), &opts, CountVisits), 0);
+        for (size_t i = 0; i < visits.counts.size(); i++) {
+            ASSERT_EQ(visits.counts[i], i >= 5 ? 1 : 0) << i << " with " << threads << " threads";
+        }
+    }
+}
+
+TEST(ParallelRange, EmptyRange) {
+    RvParallelOpts opts;
+    rv_parallel_opts_init(&opts);
+    EXPECT_EQ(rv_parallel_run(10, 10, &opts, [](void*, uint64_t, uint64_t, RvParallelOut*) {
+        ADD_FAILURE();
+        return 0;
+    }), 0);
+}
+
+struct Ordered {
+    uint64_t             chunkSize;
+    unsigned             window;
+    uint64_t             cancelAt;
+    std::atomic<uint64_t> emits{0};
+    std::atomic<bool>    overran{false};
+    std::string          text;
+};
+
+static int PrintIndices(void* ctx, uint64_t begin, uint64_t end, RvParallelOut* out) {
+    Ordered* ordered = static_cast<Ordered*>(ctx);
+    if (begin / ordered->chunkSize >= ordered->emits + ordered->window) {
+        ordered->overran = true;
+    }
+    for (uint64_t i = begin; i < end; i++) {
+        if (i == ordered->cancelAt) {
+            return 7;
+        }
+        // Uneven work, so chunks finish out of order.
+        volatile uint64_t spin = (i % 13 == 0) ? 2000 : 0;
+        while (spin > 0) {
+            spin--;
+        }
+        rv_parallel_printf(out, "%llu\n", (unsigned long long)i);
+    }
+    return 0;
+}
+
+static void Collect(void* ctx, const char* data, size_t len) {
+    Ordered* ordered = static_cast<Ordered*>(ctx);
+    ordered->text.append(data, len);
+    ordered->emits++;
+}
+
+static std::string Sequential(uint64_t start, uint64_t end) {
+    std::string text;
+    for (uint64_t i = start; i < end; i++) {
+        text += std::to_string(i) + "\n";
+    }
+    return text;
+}
+
+static int RunOrdered(Ordered& ordered, uint64_t end) {
+    RvParallelOpts opts;
+    rv_parallel_opts_init(&opts);
+    opts.numThreads = 4;
+    opts.chunkSize = ordered.chunkSize;
+    opts.window = ordered.window;
+    opts.emit = Collect;
+    opts.ctx = &ordered;
+    return rv_parallel_run(0, end, &opts, PrintIndices);
+}
+
+TEST(ParallelRange, OrderedWithinWindow) {
+    Ordered ordered;
+    ordered.chunkSize = 50;
+    ordered.window = 6;
+    ordered.cancelAt = UINT64_MAX;
+    ASSERT_EQ(RunOrdered(ordered, 20011), 0);
+    EXPECT_EQ(ordered.text, Sequential(0, 20011));
+    EXPECT_EQ(ordered.emits, (20011 + 49) / 50);
+    EXPECT_FALSE(ordered.overran);
+}
+
+TEST(ParallelRange, Cancel) {
+    Ordered ordered;
+    ordered.chunkSize = 50;
+    ordered.window = 6;
+    ordered.cancelAt = 12345;
+    ASSERT_EQ(RunOrdered(ordered, 20011), 7);
+    // Everything emitted is in order and stops before the cancelling chunk.
+    EXPECT_EQ(ordered.text, Sequential(0, ordered.emits * 50));
+    EXPECT_LE(ordered.emits, 12345u / 50);
+}
+
+struct Progress {
+    std::atomic<unsigned> calls{0};
+    uint64_t              lastDone = 0;
+    bool                  backwards = false;
+};
+
+static void Discard(void*, const char*, size_t) {}
+
+TEST(ParallelRange, OrderedProgressIsThrottled) {
+    // Thousands of chunks a second get emitted, and each one wakes the
+    // starting thread; progress should still only come every 250ms or so.
+    Progress progress;
+    RvParallelOpts opts;
+    rv_parallel_opts_init(&opts);
+    opts.numThreads = 4;
+    opts.chunkSize = 1;
+    opts.emit = Discard;
+    opts.progress = [](void* ctx, uint64_t chunksDone, uint64_t numChunks) {
+        Progress* p = static_cast<Progress*>(ctx);
+        p->calls++;
+        p->backwards |= chunksDone < p->lastDone || chunksDone > numChunks;
+        p->lastDone = chunksDone;
+    };
+    opts.ctx = &progress;
+    auto begin = std::chrono::steady_clock::now();
+    ASSERT_EQ(rv_parallel_run(0, 2000, &opts, [](void*, uint64_t, uint64_t, RvParallelOut*) {
+        std::this_thread::sleep_for(std::chrono::microseconds(1000));
+        return 0;
+    }), 0);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin);
+    ASSERT_GT(ms.count(), 300);
+    EXPECT_GE(progress.calls, 1u);
+    EXPECT_LE(progress.calls, ms.count() / 250 + 1) << "in " << ms.count() << "ms";
+    EXPECT_FALSE(progress.backwards);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
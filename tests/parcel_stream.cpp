@@ -0,0 +1,181 @@
+#include "gtest/gtest.h"
+#include "test_common.h"
+
+#include <cstddef>
+#include <vector>
+
+// Same numbers rv_disass.c asserts for its copy.
+TEST(ParcelStream, Layout) {
+    EXPECT_EQ(sizeof(RvParcelInst), 16 + sizeof(const char*));
+    EXPECT_EQ(offsetof(RvParcelInst, addr), 0u);
+    EXPECT_EQ(offsetof(RvParcelInst, length), 8u);
+    EXPECT_EQ(offsetof(RvParcelInst, inst), 12u);
+    EXPECT_EQ(offsetof(RvParcelInst, text), 16u);
+}
+
+struct Parcel {
+    uint64_t    addr;
+    uint32_t    length;
+    std::string text;
+};
+
+// Little-endian bytes for a list of 16-bit parcels.
+std::vector<uint8_t> Bytes(const std::vector<uint16_t>& parcels) {
+    std::vector<uint8_t> out;
+    for (uint16_t p : parcels) {
+        out.push_back(static_cast<uint8_t>(p));
+        out.push_back(static_cast<uint8_t>(p >> 8));
+    }
+    return out;
+}
+
+size_t Decode(const std::vector<uint8_t>& bytes, uint64_t addr, std::vector<Parcel>* out, size_t stopAfter = 0) {
+    struct Ctx {
+        std::vector<Parcel>* out;
+        size_t stopAfter;
+    } ctx = {out, stopAfter};
+    return rv_disass_parcels(bytes.data(), bytes.size(), addr, [](void* vctx, const RvParcelInst* inst) {
+        Ctx* ctx = static_cast<Ctx*>(vctx);
+        ctx->out->push_back({inst->addr, inst->length, inst->text});
+        return (ctx->out->size() == ctx->stopAfter) ? 1 : 0;
+    }, &ctx);
+}
+
+TEST(ParcelStream, MixedLengths) {
+    rv_reset_options();
+    std::vector<uint8_t> bytes = Bytes({
+        0x0505,                              // c.addi a0, 1
+        0x0513, 0x0015,                      // addi a0, a0, 1
+        0x8082,                              // c.jr ra
+        0x001f, 0x0000, 0x0000,              // 48-bit
+        0x003f, 0x0000, 0x0000, 0x0000,      // 64-bit
+        0x107f, 0, 0, 0, 0, 0,               // 80 + 16 * 1 bit
+        0x707f,                              // >= 192-bit, no length field
+        0x0000,                              // c.addi4spn with a zero imm is illegal
+        0x6108,                              // c.ld a0, 0(a0)
+    });
+    std::vector<Parcel> got;
+    EXPECT_EQ(Decode(bytes, 0x80000000, &got), bytes.size());
+
+    ASSERT_EQ(got.size(), 9u);
+    uint64_t addr = 0x80000000;
+    for (const Parcel& p : got) {
+        EXPECT_EQ(p.addr, addr);
+        addr += p.length;
+    }
+    EXPECT_EQ(got[0].length, 2u);
+    EXPECT_EQ(got[0].text, "addi    a0, a0, 1");
+    EXPECT_EQ(got[1].length, 4u);
+    EXPECT_EQ(got[1].text, "addi    a0, a0, 1");
+    EXPECT_EQ(got[2].length, 2u);
+    EXPECT_EQ(got[2].text, "jalr    zero, 0(ra)");
+    EXPECT_EQ(got[3].length, 6u);
+    EXPECT_EQ(got[3].text, "unknown");
+    EXPECT_EQ(got[4].length, 8u);
+    EXPECT_EQ(got[5].length, 12u);
+    EXPECT_EQ(got[6].length, 2u);
+    EXPECT_EQ(got[6].text, "unknown");
+    EXPECT_EQ(got[7].length, 2u);
+    EXPECT_EQ(got[7].text, "unknown");
+    EXPECT_EQ(got[8].text, "ld      a0, 0(a0)");
+}
+
+TEST(ParcelStream, PartialTail) {
+    // The second half of the addi hasn't been fetched yet, and an odd byte
+    // is never a parcel.
+    std::vector<uint8_t> bytes = Bytes({0x0505, 0x0513});
+    std::vector<Parcel> got;
+    EXPECT_EQ(Decode(bytes, 0x1000, &got), 2u);
+    EXPECT_EQ(got.size(), 1u);
+
+    bytes = Bytes({0x0505});
+    bytes.push_back(0x13);
+    got.clear();
+    EXPECT_EQ(Decode(bytes, 0x1000, &got), 2u);
+    EXPECT_EQ(got.size(), 1u);
+
+    // Nothing whole yet is 0 bytes used, not a failure.
+    got.clear();
+    size_t used = Decode(Bytes({0x0513}), 0x1000, &got);
+    EXPECT_EQ(used, 0u);
+    EXPECT_NE(used, RV_PARCELS_FAILED);
+    EXPECT_TRUE(got.empty());
+}
+
+TEST(ParcelStream, StopEarly) {
+    std::vector<uint8_t> bytes = Bytes({0x0505, 0x0513, 0x0015, 0x0505});
+    std::vector<Parcel> got;
+    EXPECT_EQ(Decode(bytes, 0x1000, &got, 2), 6u);
+    EXPECT_EQ(got.size(), 2u);
+}
+
+TEST(ParcelStream, AcrossBlocks) {
+    // Mostly 32-bit insts with a compressed one every so often, so the
+    // 32-bit ones straddle length detection blocks at either alignment.
+    std::vector<uint16_t> parcels;
+    size_t expected = 0;
+    while (parcels.size() < 2000) {
+        parcels.push_back(0x0513);
+        parcels.push_back(0x0015);
+        expected++;
+        if (expected % 7 == 0) {
+            parcels.push_back(0x0505);
+            expected++;
+        }
+    }
+    std::vector<uint8_t> bytes = Bytes(parcels);
+    std::vector<Parcel> got;
+    EXPECT_EQ(Decode(bytes, 0, &got), bytes.size());
+    ASSERT_EQ(got.size(), expected);
+    uint64_t addr = 0;
+    for (const Parcel& p : got) {
+        ASSERT_EQ(p.addr, addr);
+        ASSERT_EQ(p.text, "addi    a0, a0, 1");
+        addr += p.length;
+    }
+}
+
+TEST(ParcelStream, EveryLengthInEveryLane) {
+    // Straight from the spec's table, to check the four-at-a-time lengths.
+    auto parcelsFor = [](uint32_t p) -> uint32_t {
+        uint32_t nnn = (p >> 12) & 0x7;
+        if ((p & 0x3) != 0x3) {
+            return 1;
+        } else if ((p & 0x1C) != 0x1C) {
+            return 2;
+        } else if ((p & 0x3F) == 0x1F) {
+            return 3;
+        } else if ((p & 0x3F) == 0x3F && (p & 0x40) == 0) {
+            return 4;
+        } else if (nnn != 0x7) {
+            return 5 + nnn;
+        }
+        return 1;
+    };
+    // c.nops put p in each lane of the first four; the rest is room for its
+    // longest length plus a tail that goes through the one-at-a-time path.
+    for (size_t lane = 0; lane < 4; lane++) {
+        for (uint32_t p = 0; p < 0x10000; p++) {
+            std::vector<uint16_t> parcels(lane, 0x0001);
+            parcels.push_back(static_cast<uint16_t>(p));
+            parcels.resize(15, 0x0001);
+            std::vector<Parcel> got;
+            Decode(Bytes(parcels), 0, &got, lane + 1);
+            ASSERT_EQ(got.size(), lane + 1);
+            ASSERT_EQ(got[lane].length, 2 * parcelsFor(p)) << "parcel " << p << " in lane " << lane;
+        }
+    }
+    // On its own, and only as long as it says, so anything under four
+    // parcels is all tail.
+    for (uint32_t p = 0; p < 0x10000; p++) {
+        std::vector<uint16_t> parcels(parcelsFor(p), 0x0001);
+        parcels[0] = static_cast<uint16_t>(p);
+        std::vector<Parcel> got;
+        ASSERT_EQ(Decode(Bytes(parcels), 0, &got, 1), 2 * parcels.size()) << "parcel " << p;
+    }
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
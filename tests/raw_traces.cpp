@@ -0,0 +1,219 @@
+#include "gtest/gtest.h"
+#include "rv_disass.h"
+#include "trace_map.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Same numbers rv_disass.c asserts for its copy; a mismatch corrupts files.
+TEST(RawTrace, Layout) {
+    EXPECT_EQ(sizeof(RvTraceHeader), 16u);
+    EXPECT_EQ(offsetof(RvTraceHeader, magic), 0u);
+    EXPECT_EQ(offsetof(RvTraceHeader, version), 4u);
+    EXPECT_EQ(offsetof(RvTraceHeader, recordSize), 6u);
+    EXPECT_EQ(offsetof(RvTraceHeader, reserved), 8u);
+    EXPECT_EQ(sizeof(RvTraceRecord), 40u);
+    EXPECT_EQ(offsetof(RvTraceRecord, pc), 0u);
+    EXPECT_EQ(offsetof(RvTraceRecord, rdValue), 8u);
+    EXPECT_EQ(offsetof(RvTraceRecord, inst), 16u);
+    EXPECT_EQ(offsetof(RvTraceRecord, rd), 20u);
+    EXPECT_EQ(offsetof(RvTraceRecord, reserved), 21u);
+    EXPECT_EQ(offsetof(RvTraceRecord, cycle), 24u);
+    EXPECT_EQ(offsetof(RvTraceRecord, hart), 32u);
+    EXPECT_EQ(offsetof(RvTraceRecord, flags), 36u);
+    EXPECT_EQ(offsetof(RvTraceRecord, cycle), static_cast<size_t>(RV_TRACE_COMPARED_BYTES));
+}
+
+class RawTraceFile : public ::testing::Test {
+protected:
+    void SetUp() override {
+        rv_reset_options();
+        m_dut = ::testing::TempDir() + "raw_trace_dut.rvt";
+        m_ref = ::testing::TempDir() + "raw_trace_ref.rvt";
+    }
+    void TearDown() override {
+        rv_reset_options();
+        std::remove(m_dut.c_str());
+        std::remove(m_ref.c_str());
+    }
+
+    // n records of addi a0, a0, 1; the one at bad (if any) writes a different value.
+    void WriteTrace(const std::string& path, size_t n, size_t bad = SIZE_MAX) {
+        ASSERT_EQ(rv_rawtrace_open(path.c_str()), 0);
+        for (size_t i = 0; i < n; i++) {
+            rv_rawtrace_put(0, 100 + i, 0x80000000 + 4 * i, 0x00150513, 10, (i == bad) ? 0xbad : i);
+        }
+        rv_rawtrace_close();
+    }
+
+    size_t FirstMismatch() {
+        TraceMap dut, ref;
+        EXPECT_EQ(trace_map_open(m_dut.c_str(), &dut), 0);
+        EXPECT_EQ(trace_map_open(m_ref.c_str(), &ref), 0);
+        size_t n = (dut.count < ref.count) ? dut.count : ref.count;
+        size_t at = trace_first_mismatch(dut.records, ref.records, n);
+        trace_map_close(&dut);
+        trace_map_close(&ref);
+        return at;
+    }
+
+    std::string m_dut;
+    std::string m_ref;
+};
+
+TEST_F(RawTraceFile, WriteAndMap) {
+    ASSERT_EQ(rv_rawtrace_open(m_dut.c_str()), 0);
+    rv_rawtrace_put(3, 7, 0x1000, 0x00150513, 10, 42);
+    rv_rawtrace_put(3, 8, 0x1004, 0x00000073, 0, 42); // No writeback: value dropped
+    rv_rawtrace_close();
+
+    TraceMap map;
+    ASSERT_EQ(trace_map_open(m_dut.c_str(), &map), 0);
+    ASSERT_EQ(map.count, 2u);
+    EXPECT_EQ(map.records[0].pc, 0x1000u);
+    EXPECT_EQ(map.records[0].inst, 0x00150513u);
+    EXPECT_EQ(map.records[0].rd, 10);
+    EXPECT_EQ(map.records[0].rdValue, 42u);
+    EXPECT_EQ(map.records[0].cycle, 7u);
+    EXPECT_EQ(map.records[0].hart, 3u);
+    EXPECT_EQ(map.records[1].rd, 0);
+    EXPECT_EQ(map.records[1].rdValue, 0u);
+    trace_map_close(&map);
+}
+
+TEST_F(RawTraceFile, BadHeaders) {
+    RvTraceHeader good;
+    memset(&good, 0, sizeof(good));
+    good.magic = RV_TRACE_MAGIC;
+    good.version = RV_TRACE_VERSION;
+    good.recordSize = sizeof(RvTraceRecord);
+
+    auto check = [&](RvTraceHeader hdr, size_t bytes) {
+        {
+            std::ofstream out(m_dut, std::ios::binary);
+            out.write(reinterpret_cast<const char*>(&hdr), bytes);
+        }
+        TraceMap map;
+        int err = trace_map_open(m_dut.c_str(), &map);
+        trace_map_close(&map);
+        return err;
+    };
+    EXPECT_EQ(check(good, sizeof(good)), 0);
+    EXPECT_NE(check(good, sizeof(good) - 1), 0);
+
+    RvTraceHeader bad = good;
+    bad.magic ^= 1;
+    EXPECT_NE(check(bad, sizeof(bad)), 0);
+    bad = good;
+    bad.version++;
+    EXPECT_NE(check(bad, sizeof(bad)), 0);
+    bad = good;
+    bad.recordSize--;
+    EXPECT_NE(check(bad, sizeof(bad)), 0);
+
+    TraceMap map;
+    EXPECT_NE(trace_map_open("/nonexistent/trace.rvt", &map), 0);
+}
+
+TEST_F(RawTraceFile, FirstMismatch) {
+    // 64-record blocks, then a tail of 10.
+    const size_t n = 64 * 3 + 10;
+    WriteTrace(m_ref, n);
+
+    WriteTrace(m_dut, n);
+    EXPECT_EQ(FirstMismatch(), n);
+
+    WriteTrace(m_dut, n, 100); // Inside the second block
+    EXPECT_EQ(FirstMismatch(), 100u);
+
+    WriteTrace(m_dut, n, 64 * 3 + 5); // In the tail
+    EXPECT_EQ(FirstMismatch(), 64u * 3 + 5);
+
+    WriteTrace(m_dut, n, 0);
+    EXPECT_EQ(FirstMismatch(), 0u);
+
+    WriteTrace(m_dut, 150); // Shorter, with a partial block at the end
+    EXPECT_EQ(FirstMismatch(), 150u);
+}
+
+TEST_F(RawTraceFile, MismatchIgnoresBookkeeping) {
+    WriteTrace(m_ref, 70);
+    ASSERT_EQ(rv_rawtrace_open(m_dut.c_str()), 0);
+    for (size_t i = 0; i < 70; i++) {
+        // Other hart and cycles: not architectural, so not a divergence.
+        rv_rawtrace_put(1, 5000 + 3 * i, 0x80000000 + 4 * i, 0x00150513, 10, i);
+    }
+    rv_rawtrace_close();
+    EXPECT_EQ(FirstMismatch(), 70u);
+}
+
+TEST_F(RawTraceFile, PrintFollowsOptions) {
+    RvTraceRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.pc = 0x1000;
+    rec.inst = 0x00150513;
+    rec.rd = 10;
+    rec.rdValue = 0x2a;
+
+    auto print = [&]() {
+        FILE* out = tmpfile();
+        trace_print_record(out, '<', 5, &rec);
+        rewind(out);
+        char line[256] = {0};
+        EXPECT_NE(fgets(line, sizeof(line), out), nullptr);
+        fclose(out);
+        return std::string(line);
+    };
+    EXPECT_NE(print().find("a0=0x2a"), std::string::npos);
+    rv_set_option("NoAbiNames", 1);
+    std::string line = print();
+    EXPECT_NE(line.find("addi    x10, x10, 1"), std::string::npos) << line;
+    EXPECT_NE(line.find("x10=0x2a"), std::string::npos) << line;
+}
+
+TEST(RegNames, ByName) {
+    rv_reset_options();
+    EXPECT_STREQ(rv_reg_name(10), "a0");
+    EXPECT_EQ(rv_reg_by_name("a0"), 10);
+    EXPECT_EQ(rv_reg_by_name("x10"), 10);
+    EXPECT_EQ(rv_reg_by_name("fp"), 8);
+    EXPECT_EQ(rv_reg_by_name("zero"), 0);
+    EXPECT_EQ(rv_reg_by_name("x32"), -1);
+    EXPECT_EQ(rv_reg_by_name("x"), -1);
+    EXPECT_EQ(rv_reg_by_name("q0"), -1);
+    rv_set_option("NoAbiNames", 1);
+    EXPECT_STREQ(rv_reg_name(10), "x10");
+    EXPECT_EQ(rv_reg_by_name("a0"), 10); // Parsing takes either
+    rv_reset_options();
+}
+
+TEST(TraceArgs, Numbers) {
+    unsigned long long value = 0;
+    auto parse = [&](const char* text, unsigned long long max) -> std::string {
+        const char* end = trace_parse_number(text, max, &value);
+        return (end == nullptr) ? "bad" : std::to_string(value) + "|" + end;
+    };
+    EXPECT_EQ(parse("12", 100), "12|");
+    EXPECT_EQ(parse("0x10:20", 100), "16|:20");
+    EXPECT_EQ(parse("100", 100), "100|");
+    EXPECT_EQ(parse("18446744073709551615", UINT64_MAX), "18446744073709551615|");
+    EXPECT_EQ(parse("7foo", 100), "7|foo"); // Callers check what's left
+
+    EXPECT_EQ(parse("101", 100), "bad");
+    EXPECT_EQ(parse("18446744073709551616", UINT64_MAX), "bad");
+    EXPECT_EQ(parse("-1", UINT64_MAX), "bad");
+    EXPECT_EQ(parse("+1", 100), "bad");
+    EXPECT_EQ(parse(" 1", 100), "bad");
+    EXPECT_EQ(parse("foo", 100), "bad");
+    EXPECT_EQ(parse("", 100), "bad");
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
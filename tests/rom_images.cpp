@@ -0,0 +1,148 @@
+#include "gtest/gtest.h"
+#include "test_common.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+class RomImage : public ::testing::Test {
+protected:
+    void SetUp() override {
+        rv_reset_options();
+        rv_rom_unload_all();
+        m_image = ::testing::TempDir() + "rom_image.memh";
+        m_sidecar = ::testing::TempDir() + "rom_image.rvrom";
+    }
+    void TearDown() override {
+        rv_rom_unload_all();
+        std::remove(m_image.c_str());
+        std::remove(m_sidecar.c_str());
+    }
+
+    void WriteImage(const char* contents) {
+        std::ofstream out(m_image);
+        out << contents;
+    }
+
+    std::string m_image;
+    std::string m_sidecar;
+};
+
+TEST_F(RomImage, MemhLookup) {
+    WriteImage(
+        "// boot rom\n"
+        "00000093 fff00093\n"
+        "/* skip one */ @3\n"
+        "0ff0_000f\n"
+        "xxxxxxxx 00000073\n");
+    ASSERT_EQ(rv_rom_prerender(m_image.c_str(), 0x1000, false, m_sidecar.c_str()), 0);
+    ASSERT_EQ(rv_rom_load(m_sidecar.c_str()), 0);
+
+    EXPECT_STREQ(rv_disass_at(0x1000, 0x00000093), "addi    ra, zero, 0");
+    EXPECT_STREQ(rv_disass_at(0x1004, 0xfff00093), "addi    ra, zero, -1");
+    EXPECT_STREQ(rv_disass_at(0x100c, 0x0ff0000f), "fence   iorw, iorw");
+    EXPECT_STREQ(rv_disass_at(0x1014, 0x00000073), "ecall");
+
+    // Holes, misses and changed words all fall back to live disassembly.
+    EXPECT_STREQ(rv_disass_at(0x1008, 0x00000093), "addi    ra, zero, 0");
+    EXPECT_STREQ(rv_disass_at(0x1010, 0x00000073), "ecall");
+    EXPECT_STREQ(rv_disass_at(0x0ffc, 0x00000073), "ecall");
+    EXPECT_STREQ(rv_disass_at(0x1018, 0x00000073), "ecall");
+    EXPECT_STREQ(rv_disass_at(0x1000, 0x00000073), "ecall");
+    EXPECT_STREQ(rv_disass_at(0x1002, 0x00000073), "ecall");
+}
+
+TEST_F(RomImage, OptionsMustMatch) {
+    WriteImage("00000013\n");
+    rv_set_option("UsePseudoInsts", true);
+    ASSERT_EQ(rv_rom_prerender(m_image.c_str(), 0, false, m_sidecar.c_str()), 0);
+    ASSERT_EQ(rv_rom_load(m_sidecar.c_str()), 0);
+
+    EXPECT_STREQ(rv_disass_at(0, 0x00000013), "nop");
+    rv_set_option("UsePseudoInsts", false);
+    EXPECT_STREQ(rv_disass_at(0, 0x00000013), "addi    zero, zero, 0");
+}
+
+TEST_F(RomImage, Binary) {
+    {
+        std::ofstream out(m_image, std::ios::binary);
+        const unsigned char bytes[] = {0x93, 0x00, 0x00, 0x00, 0x73, 0x00, 0x00, 0x00};
+        out.write(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+    }
+    ASSERT_EQ(rv_rom_prerender(m_image.c_str(), 0x80000000, true, m_sidecar.c_str()), 0);
+    ASSERT_EQ(rv_rom_load(m_sidecar.c_str()), 0);
+
+    EXPECT_STREQ(rv_disass_at(0x80000000, 0x00000093), "addi    ra, zero, 0");
+    EXPECT_STREQ(rv_disass_at(0x80000004, 0x00000073), "ecall");
+}
+
+TEST_F(RomImage, HighAddresses) {
+    // Only the words from the first one on are kept, so this is a small
+    // image, not a 2GiB one. base is still the PC of @0.
+    WriteImage("@20000000\n00000093 00000073\n");
+    ASSERT_EQ(rv_rom_prerender(m_image.c_str(), 0, false, m_sidecar.c_str()), 0);
+    ASSERT_EQ(rv_rom_load(m_sidecar.c_str()), 0);
+    EXPECT_STREQ(rv_disass_at(0x80000000, 0x00000093), "addi    ra, zero, 0");
+    EXPECT_STREQ(rv_disass_at(0x80000004, 0x00000073), "ecall");
+
+    WriteImage("@80000000\n00000093\n");
+    EXPECT_EQ(rv_rom_prerender(m_image.c_str(), 0, false, m_sidecar.c_str()), 0);
+
+    WriteImage("@80000000\n00000093\n@ffffffff 00000073\n");
+    EXPECT_NE(rv_rom_prerender(m_image.c_str(), 0, false, m_sidecar.c_str()), 0);
+}
+
+TEST_F(RomImage, SparseImages) {
+    // Too far apart to hold in one image.
+    WriteImage("@0 00000013\n@1000000 00000013\n");
+    EXPECT_NE(rv_rom_prerender(m_image.c_str(), 0, false, m_sidecar.c_str()), 0);
+
+    // Before the first word.
+    WriteImage("@10 00000013\n@0 00000013\n");
+    EXPECT_NE(rv_rom_prerender(m_image.c_str(), 0, false, m_sidecar.c_str()), 0);
+}
+
+TEST_F(RomImage, BadInputs) {
+    WriteImage("0000g093\n");
+    EXPECT_NE(rv_rom_prerender(m_image.c_str(), 0, false, m_sidecar.c_str()), 0);
+    EXPECT_NE(rv_rom_load(m_image.c_str()), 0);
+    EXPECT_NE(rv_rom_load("/nonexistent/rom.rvrom"), 0);
+}
+
+TEST_F(RomImage, CorruptSidecars) {
+    WriteImage("00000013\n00008067\n");
+    ASSERT_EQ(rv_rom_prerender(m_image.c_str(), 0, false, m_sidecar.c_str()), 0);
+    std::string good;
+    {
+        std::ifstream in(m_sidecar, std::ios::binary);
+        good.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    auto load = [&](const std::string& bytes) {
+        {
+            std::ofstream out(m_sidecar, std::ios::binary);
+            out.write(bytes.data(), bytes.size());
+        }
+        rv_rom_unload_all();
+        return rv_rom_load(m_sidecar.c_str());
+    };
+    ASSERT_EQ(load(good), 0);
+
+    // 24-byte header (textSize last), 2 words, then 2 offsets.
+    const size_t offsets = 24 + 2 * 4;
+    uint32_t textSize;
+    memcpy(&textSize, &good[20], sizeof(textSize));
+    std::string bad = good;
+    memcpy(&bad[offsets + 4], &textSize, sizeof(textSize)); // Just past the end
+    EXPECT_EQ(load(bad), -1);
+    bad = good;
+    bad[offsets + 7] ^= 0x40; // Far past it
+    EXPECT_EQ(load(bad), -1);
+    bad = good;
+    bad.back() = 'x'; // Last string runs off the end
+    EXPECT_EQ(load(bad), -1);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
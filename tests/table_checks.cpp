@@ -0,0 +1,109 @@
+#include "gtest/gtest.h"
+#include "test_common.h"
+
+#include <cinttypes>
+
+// Checks on the decode table itself, decided from the searchVal/searchMask
+// pairs rather than by sweeping all 2^32 words. Cheap enough to always run.
+
+// Two entries can both match some word iff they agree on every bit that
+// both of them care about. If so, OR-ing the values gives such a word.
+static bool EntriesOverlap(const OpInfo& a, const OpInfo& b, uint32_t* example) {
+    if (((a.searchVal ^ b.searchVal) & a.searchMask & b.searchMask) != 0) {
+        return false;
+    }
+    *example = a.searchVal | b.searchVal;
+    return true;
+}
+
+// Tiny deterministic PRNG so failures are reproducible.
+static uint32_t NextRand(uint32_t* state) {
+    *state = *state * 1664525u + 1013904223u;
+    return *state;
+}
+
+TEST(DecodeTable, ValuesWithinMasks) {
+    for (uint32_t i = 0; i < UncompressedInstsSize; i++) {
+        const OpInfo& info = UncompressedInsts[i];
+        EXPECT_EQ(info.searchVal & ~info.searchMask, 0u)
+            << info.name << " can never match: value has bits outside its mask";
+    }
+}
+
+TEST(DecodeTable, NoOverlap) {
+    for (uint32_t i = 0; i < UncompressedInstsSize; i++) {
+        for (uint32_t j = i + 1; j < UncompressedInstsSize; j++) {
+            uint32_t example = 0;
+            if (EntriesOverlap(UncompressedInsts[i], UncompressedInsts[j], &example)) {
+                char hex[16];
+                snprintf(hex, sizeof(hex), "0x%08" PRIx32, example);
+                ADD_FAILURE() << UncompressedInsts[i].name << " and "
+                              << UncompressedInsts[j].name << " overlap, e.g. "
+                              << hex << " (decodes as "
+                              << rv_find_op_linear(example)->name << ")";
+            }
+        }
+    }
+}
+
+// The derived lookup must agree with the linear reference. Probe every entry
+// at its own value, with all don't-care bits set, with random don't-care
+// fills, and with each cared-about bit flipped (the near misses).
+TEST(DecodeTable, DerivedMatchesLinear) {
+    uint32_t rng = 1;
+    auto check = [](uint32_t inst) {
+        const OpInfo* fast = rv_find_op(inst);
+        const OpInfo* ref  = rv_find_op_linear(inst);
+        char hex[16];
+        snprintf(hex, sizeof(hex), "0x%08" PRIx32, inst);
+        ASSERT_EQ(fast, ref) << "when decoding " << hex << ": got "
+                             << (fast ? fast->name : "unknown") << ", expected "
+                             << (ref ? ref->name : "unknown");
+    };
+
+    for (uint32_t i = 0; i < UncompressedInstsSize; i++) {
+        const OpInfo& info = UncompressedInsts[i];
+        ASSERT_EQ(rv_find_op_linear(info.searchVal), &info)
+            << info.name << " is shadowed by an earlier entry";
+
+        check(info.searchVal);
+        check(info.searchVal | ~info.searchMask);
+        for (int trial = 0; trial < 64; trial++) {
+            check(info.searchVal | (NextRand(&rng) & ~info.searchMask));
+        }
+        for (int bit = 0; bit < 32; bit++) {
+            if (info.searchMask & (1u << bit)) {
+                check(info.searchVal ^ (1u << bit));
+            }
+        }
+    }
+
+    for (int trial = 0; trial < (1 << 16); trial++) {
+        check(NextRand(&rng));
+    }
+}
+
+// The generator and SV code only see the table through the accessors, and
+// this file only sees it through test_common.h's copy of OpInfo; they must agree.
+TEST(DecodeTable, Accessors) {
+    ASSERT_EQ(rv_opcode_count(), static_cast<int>(UncompressedInstsSize));
+    for (int i = 0; i < rv_opcode_count(); i++) {
+        unsigned int match = 0;
+        unsigned int mask = 0;
+        ASSERT_EQ(rv_opcode_pattern(i, &match, &mask), 0);
+        EXPECT_STREQ(rv_opcode_name(i), UncompressedInsts[i].name);
+        EXPECT_EQ(match, UncompressedInsts[i].searchVal) << UncompressedInsts[i].name;
+        EXPECT_EQ(mask, UncompressedInsts[i].searchMask) << UncompressedInsts[i].name;
+        EXPECT_EQ(rv_opcode_id(match), i) << UncompressedInsts[i].name;
+    }
+    unsigned int match = 0;
+    unsigned int mask = 0;
+    EXPECT_NE(rv_opcode_pattern(-1, &match, &mask), 0);
+    EXPECT_NE(rv_opcode_pattern(rv_opcode_count(), &match, &mask), 0);
+    EXPECT_STREQ(rv_opcode_name(rv_opcode_count()), "unknown");
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
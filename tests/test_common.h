@@ -4,6 +4,35 @@ extern char* rv_disass(unsigned int inst);
 extern void rv_free(char* str);
 void rv_set_option(const char* name, bool enabled);
 void rv_reset_options();
+int rv_rom_prerender(const char* image, unsigned int base, char isBinary, const char* sidecar);
+int rv_rom_load(const char* sidecar);
+void rv_rom_unload_all();
+const char* rv_disass_at(unsigned int pc, unsigned int inst);
+void rv_cov_sample(unsigned int inst);
+void rv_cov_reset();
+int rv_cov_bins_hit();
+int rv_cov_bins_total();
+int rv_cov_report(const char* path);
+int rv_trace_set_filter(const char* spec);
+char rv_trace_gate(unsigned long long cycle, unsigned long long pc, unsigned int inst);
+int rv_trace_open(const char* path);
+char rv_trace_inst(unsigned long long cycle, unsigned long long pc, unsigned int inst);
+void rv_trace_close();
+void rv_trace_hart_inst(int hart, unsigned long long cycle, unsigned long long pc, unsigned int inst);
+void rv_trace_harts_flush(unsigned long long cycle);
+void rv_trace_set_dataflow(char enabled);
+unsigned long long rv_trace_dataflow_hist(int distance);
+int rv_trace_dataflow_report(const char* path);
+int rv_trace_set_compact(unsigned int window);
+typedef struct {
+    uint64_t    addr;
+    uint32_t    length;
+    uint32_t    inst;
+    const char* text;
+} RvParcelInst;
+typedef int (*RvParcelFn)(void* ctx, const RvParcelInst* inst);
+#define RV_PARCELS_FAILED ((size_t)-1)
+size_t rv_disass_parcels(const void* bytes, size_t size, unsigned long long addr, RvParcelFn fn, void* ctx);
 // Implementation details
 enum InstLayout {
     InstLayout_R,
@@ -18,6 +47,8 @@ enum InstLayout {
     InstLayout_B,
     InstLayout_U,
     InstLayout_J,
+    InstLayout_Csr,
+    InstLayout_CsrImm,
     InstLayout_None,
 };
 struct OpInfo {
@@ -29,6 +60,16 @@ struct OpInfo {
 };
 extern const OpInfo UncompressedInsts[];
 extern const uint32_t UncompressedInstsSize;
+const OpInfo* rv_find_op(uint32_t inst);
+const OpInfo* rv_find_op_linear(uint32_t inst);
+int rv_opcode_id(unsigned int inst);
+int rv_opcode_id_by_name(const char* name);
+int rv_opcode_count();
+const char* rv_opcode_name(int id);
+int rv_opcode_pattern(int id, unsigned int* match, unsigned int* mask);
+int rv_decode_fields(unsigned int inst, int* rd, int* rs1, int* rs2, int* csr);
+const char* rv_reg_name(unsigned int reg);
+int rv_reg_by_name(const char* name);
 }
 
 // Inline wrapper so we don't have to manually free
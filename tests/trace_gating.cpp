@@ -0,0 +1,284 @@
+#include "gtest/gtest.h"
+#include "test_common.h"
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+constexpr uint32_t Nop    = 0x00000013;
+constexpr uint32_t Ecall  = 0x00000073;
+constexpr uint32_t Ebreak = 0x00100073;
+constexpr uint32_t Jalr   = 0x00008067; // ret
+
+// Runs insts through the gate at consecutive cycles/pcs; returns which passed.
+std::string GateAll(const std::vector<uint32_t>& insts, uint64_t pc = 0x1000) {
+    std::string out;
+    for (size_t i = 0; i < insts.size(); i++) {
+        out += rv_trace_gate(i, pc + 4 * i, insts[i]) ? '1' : '0';
+    }
+    return out;
+}
+
+TEST(TraceGating, Everything) {
+    ASSERT_EQ(rv_trace_set_filter(""), 0);
+    EXPECT_EQ(GateAll({Nop, Nop, Ecall}), "111");
+}
+
+TEST(TraceGating, PcRanges) {
+    ASSERT_EQ(rv_trace_set_filter("pc=0x1004:0x1008 pc=0x100c:0x1010"), 0);
+    EXPECT_EQ(GateAll({Nop, Nop, Nop, Nop, Nop}), "01010");
+}
+
+TEST(TraceGating, Cycles) {
+    ASSERT_EQ(rv_trace_set_filter("cycles=2:4"), 0);
+    EXPECT_EQ(GateAll({Nop, Nop, Nop, Nop, Nop}), "00110");
+}
+
+TEST(TraceGating, Ops) {
+    ASSERT_EQ(rv_trace_set_filter("ops=jalr,ecall"), 0);
+    EXPECT_EQ(GateAll({Nop, Jalr, Ecall, 0x00001001}), "0110");
+}
+
+TEST(TraceGating, Sample) {
+    ASSERT_EQ(rv_trace_set_filter("sample=3"), 0);
+    EXPECT_EQ(GateAll({Nop, Nop, Nop, Nop, Nop, Nop, Nop}), "1001001");
+}
+
+TEST(TraceGating, Triggers) {
+    ASSERT_EQ(rv_trace_set_filter("start=ebreak stop=0x00000073"), 0);
+    EXPECT_EQ(GateAll({Nop, Ebreak, Nop, Ecall, Nop, Ebreak, Nop}), "0111011");
+}
+
+TEST(TraceGating, BadSpecKeepsOldFilter) {
+    ASSERT_EQ(rv_trace_set_filter("ops=jalr"), 0);
+    EXPECT_NE(rv_trace_set_filter("ops=notanop"), 0);
+    EXPECT_NE(rv_trace_set_filter("ops="), 0);
+    EXPECT_NE(rv_trace_set_filter("ops=jalr,"), 0);
+    EXPECT_NE(rv_trace_set_filter("ops=,jalr"), 0);
+    EXPECT_NE(rv_trace_set_filter("ops=jalr,,ecall"), 0);
+    EXPECT_NE(rv_trace_set_filter("pc=10:5"), 0);
+    EXPECT_NE(rv_trace_set_filter("bogus=1"), 0);
+    EXPECT_NE(rv_trace_set_filter("sample"), 0);
+    EXPECT_EQ(GateAll({Nop, Jalr}), "01");
+}
+
+TEST(TraceGating, TextTrace) {
+    rv_reset_options();
+    std::string path = ::testing::TempDir() + "rv_trace.txt";
+    ASSERT_EQ(rv_trace_set_filter("ops=jalr"), 0);
+    ASSERT_EQ(rv_trace_open(path.c_str()), 0);
+    EXPECT_FALSE(rv_trace_inst(1, 0x1000, Nop));
+    EXPECT_TRUE(rv_trace_inst(2, 0x1004, Jalr));
+    rv_trace_close();
+
+    std::ifstream in(path);
+    std::stringstream text;
+    text << in.rdbuf();
+    std::remove(path.c_str());
+    EXPECT_EQ(text.str(), "         2  0000000000001004  00008067  jalr    zero, 0(ra)\n");
+}
+
+std::string ReadAndRemove(const std::string& path) {
+    std::ifstream in(path);
+    std::stringstream text;
+    text << in.rdbuf();
+    std::remove(path.c_str());
+    return text.str();
+}
+
+TEST(TraceGating, HartsMergeInOrder) {
+    rv_reset_options();
+    std::string path = ::testing::TempDir() + "rv_trace_harts.txt";
+    ASSERT_EQ(rv_trace_set_filter(""), 0);
+    ASSERT_EQ(rv_trace_open(path.c_str()), 0);
+    rv_trace_hart_inst(1, 5, 0x2000, Nop);
+    rv_trace_hart_inst(0, 5, 0x1000, Jalr);
+    rv_trace_hart_inst(0, 7, 0x1004, Nop);
+    rv_trace_hart_inst(1, 6, 0x2004, Ecall);
+    rv_trace_harts_flush(7); // cycle 7 stays buffered until close
+    rv_trace_close();
+
+    EXPECT_EQ(ReadAndRemove(path),
+              "         5  hart0    0000000000001000  00008067  jalr    zero, 0(ra)\n"
+              "         5  hart1    0000000000002000  00000013  addi    zero, zero, 0\n"
+              "         6  hart1    0000000000002004  00000073  ecall\n"
+              "         7  hart0    0000000000001004  00000013  addi    zero, zero, 0\n");
+}
+
+TEST(TraceGating, HartsConcurrentProducers) {
+    rv_reset_options();
+    std::string path = ::testing::TempDir() + "rv_trace_harts_mt.txt";
+    constexpr int Harts = 8;
+    constexpr uint64_t Cycles = 20000;
+    ASSERT_EQ(rv_trace_set_filter(""), 0);
+    ASSERT_EQ(rv_trace_open(path.c_str()), 0);
+
+    // Hart h retires on every (h+1)th cycle, flushed while they're running.
+    std::vector<std::thread> harts;
+    for (int h = 0; h < Harts; h++) {
+        harts.emplace_back([h] {
+            for (uint64_t c = 0; c < Cycles; c += h + 1) {
+                rv_trace_hart_inst(h, c, 0x1000 + c * 4, Nop);
+            }
+        });
+    }
+    for (int i = 0; i < 100; i++) {
+        rv_trace_harts_flush(0); // Nothing is before cycle 0; just races the producers
+    }
+    for (auto& t : harts) {
+        t.join();
+    }
+    rv_trace_harts_flush(Cycles / 2);
+    rv_trace_close();
+
+    std::istringstream lines(ReadAndRemove(path));
+    std::string line;
+    uint64_t expected = 0, lastCycle = 0;
+    int lastHart = -1;
+    for (int h = 0; h < Harts; h++) {
+        expected += (Cycles + h) / (h + 1);
+    }
+    uint64_t seen = 0;
+    while (std::getline(lines, line)) {
+        unsigned long long cycle;
+        int hart;
+        ASSERT_EQ(sscanf(line.c_str(), "%llu hart%d", &cycle, &hart), 2) << line;
+        EXPECT_TRUE(cycle > lastCycle || (cycle == lastCycle && hart > lastHart)) << line;
+        lastCycle = cycle;
+        lastHart = hart;
+        seen++;
+    }
+    EXPECT_EQ(seen, expected);
+}
+
+TEST(TraceGating, Dataflow) {
+    rv_reset_options();
+    std::string path = ::testing::TempDir() + "rv_trace_deps.txt";
+    ASSERT_EQ(rv_trace_set_filter("ops=add,sw"), 0);
+    rv_trace_set_dataflow(true);
+    ASSERT_EQ(rv_trace_open(path.c_str()), 0);
+    rv_trace_inst(0, 0x1000, 0x00100513); // addi a0, zero, 1
+    rv_trace_inst(1, 0x1004, 0x00200593); // addi a1, zero, 2
+    rv_trace_inst(2, 0x1008, Nop);
+    rv_trace_inst(3, 0x100c, 0x00b50633); // add  a2, a0, a1
+    rv_trace_inst(4, 0x1010, 0x00c12023); // sw   a2, 0(sp)
+    rv_trace_close();
+
+    // Gated-out insts still count towards the distances.
+    EXPECT_EQ(ReadAndRemove(path),
+              "         3  000000000000100c  00b50633  add     a2, a0, a1  deps a0:3@1000 a1:2@1004\n"
+              "         4  0000000000001010  00c12023  sw      a2, 0(sp)  deps a2:1@100c\n");
+    EXPECT_EQ(rv_trace_dataflow_hist(0), 1u); // sp
+    EXPECT_EQ(rv_trace_dataflow_hist(1), 1u);
+    EXPECT_EQ(rv_trace_dataflow_hist(2), 1u);
+    EXPECT_EQ(rv_trace_dataflow_hist(3), 1u);
+    EXPECT_EQ(rv_trace_dataflow_hist(4), 0u);
+
+    rv_trace_set_dataflow(false);
+    EXPECT_EQ(rv_trace_dataflow_hist(1), 0u);
+}
+
+TEST(TraceGating, DataflowPerApi) {
+    rv_reset_options();
+    std::string path = ::testing::TempDir() + "rv_trace_deps_harts.txt";
+    ASSERT_EQ(rv_trace_set_filter("ops=add"), 0);
+    rv_trace_set_dataflow(true);
+    ASSERT_EQ(rv_trace_open(path.c_str()), 0);
+    rv_trace_inst(0, 0x1000, 0x00100513);         // addi a0, zero, 1
+    rv_trace_hart_inst(64, 0, 0x3000, 0x00100513); // No such hart: dropped, not hart 0
+    rv_trace_hart_inst(0, 1, 0x2000, 0x00200593);  // addi a1, zero, 2
+    rv_trace_hart_inst(0, 2, 0x2004, 0x00b50633);  // add  a2, a0, a1
+    rv_trace_inst(3, 0x1004, 0x00b50633);
+    rv_trace_close();
+    rv_trace_set_dataflow(false);
+
+    // Each sees only its own writers.
+    EXPECT_EQ(ReadAndRemove(path),
+              "         3  0000000000001004  00b50633  add     a2, a0, a1  deps a0:1@1000\n"
+              "         2  hart0    0000000000002004  00b50633  add     a2, a0, a1  deps a1:1@2000\n");
+}
+
+TEST(TraceGating, CompactLoops) {
+    rv_reset_options();
+    std::string path = ::testing::TempDir() + "rv_trace_compact.txt";
+    ASSERT_EQ(rv_trace_set_filter(""), 0);
+    ASSERT_EQ(rv_trace_set_compact(16), 0);
+    ASSERT_EQ(rv_trace_open(path.c_str()), 0);
+    uint64_t cycle = 0;
+    const uint32_t body[] = {0x00150513, 0xfeb54ee3}; // addi a0, a0, 1; blt a0, a1, -4
+    for (int iter = 0; iter < 100; iter++) {
+        rv_trace_inst(cycle++, 0x1000, body[0]);
+        rv_trace_inst(cycle++, 0x1004, body[1]);
+    }
+    rv_trace_inst(cycle++, 0x1000, body[0]); // Half an iteration, then out
+    rv_trace_inst(cycle++, 0x1008, Ecall);
+    rv_trace_close();
+    EXPECT_EQ(rv_trace_set_compact(0), 0);
+
+    EXPECT_EQ(ReadAndRemove(path),
+              "         0  0000000000001000  00150513  addi    a0, a0, 1\n"
+              "         1  0000000000001004  feb54ee3  blt     a0, a1, -4\n"
+              "            (previous 2 insts repeated 99 more times)\n"
+              "       200  0000000000001000  00150513  addi    a0, a0, 1\n"
+              "       201  0000000000001008  00000073  ecall\n");
+}
+
+TEST(TraceGating, CompactKeepsHartsApart) {
+    rv_reset_options();
+    std::string path = ::testing::TempDir() + "rv_trace_compact_harts.txt";
+    ASSERT_EQ(rv_trace_set_filter(""), 0);
+    ASSERT_EQ(rv_trace_set_compact(16), 0);
+    ASSERT_EQ(rv_trace_open(path.c_str()), 0);
+    for (uint64_t cycle = 0; cycle < 50; cycle++) {
+        rv_trace_hart_inst(0, cycle, 0x1000, Nop);
+        rv_trace_hart_inst(1, cycle, 0x1000, Nop);
+    }
+    rv_trace_hart_inst(1, 50, 0x1004, Ecall);
+    rv_trace_close();
+    EXPECT_EQ(rv_trace_set_compact(0), 0);
+
+    // The same inst alternating between harts is a 2-inst body, not a 1-inst one.
+    EXPECT_EQ(ReadAndRemove(path),
+              "         0  hart0    0000000000001000  00000013  addi    zero, zero, 0\n"
+              "         0  hart1    0000000000001000  00000013  addi    zero, zero, 0\n"
+              "            (previous 2 insts repeated 49 more times)\n"
+              "        50  hart1    0000000000001004  00000073  ecall\n");
+}
+
+TEST(TraceGating, CompactKeepsDeps) {
+    rv_reset_options();
+    std::string path = ::testing::TempDir() + "rv_trace_compact_deps.txt";
+    ASSERT_EQ(rv_trace_set_filter(""), 0);
+    ASSERT_EQ(rv_trace_set_compact(16), 0);
+    rv_trace_set_dataflow(true);
+    ASSERT_EQ(rv_trace_open(path.c_str()), 0);
+    uint64_t cycle = 0;
+    const uint32_t body[] = {0x00150513, 0xfeb54ee3}; // addi a0, a0, 1; blt a0, a1, -4
+    for (int iter = 0; iter < 10; iter++) {
+        rv_trace_inst(cycle++, 0x1000, body[0]);
+        rv_trace_inst(cycle++, 0x1004, body[1]);
+    }
+    rv_trace_close();
+    rv_trace_set_dataflow(false);
+    EXPECT_EQ(rv_trace_set_compact(0), 0);
+
+    // The first addi has no earlier writer for a0, so it doesn't start a
+    // body; folding starts once the annotations repeat too.
+    EXPECT_EQ(ReadAndRemove(path),
+              "         0  0000000000001000  00150513  addi    a0, a0, 1\n"
+              "         1  0000000000001004  feb54ee3  blt     a0, a1, -4  deps a0:1@1000\n"
+              "         2  0000000000001000  00150513  addi    a0, a0, 1  deps a0:2@1000\n"
+              "            (previous 2 insts repeated 8 more times)\n"
+              "        19  0000000000001004  feb54ee3  blt     a0, a1, -4  deps a0:1@1000\n");
+}
+
+TEST(TraceGating, CompactWindowBound) {
+    EXPECT_NE(rv_trace_set_compact(1 << 20), 0);
+    EXPECT_EQ(rv_trace_set_compact(0), 0);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
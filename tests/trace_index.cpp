@@ -0,0 +1,255 @@
+#include "gtest/gtest.h"
+#include "rv_disass.h"
+#include "trace_map.h"
+
+#include <sys/wait.h>
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Runs rv-traceindex and rv-tracequery over a synthetic trace and checks the
+// intersections against a brute-force scan of the same records.
+
+static std::string g_indexTool = "rv-traceindex";
+static std::string g_queryTool = "rv-tracequery";
+
+static const size_t kRecords = 5000;
+
+struct TermCheck {
+    const char* key;
+    int         value;
+};
+
+class TraceIndexTools : public ::testing::Test {
+protected:
+    void SetUp() override {
+        rv_reset_options();
+        m_trace = ::testing::TempDir() + "trace_index.rvt";
+        m_index = ::testing::TempDir() + "trace_index.rvi";
+
+        // addi and add are dense, jalr and lw less so and csrrw is rare, so
+        // the rare lists gallop through the dense ones.
+        static const uint32_t kInsts[] = {
+            0x00150513, // addi a0, a0, 1
+            0x00b50633, // add  a2, a0, a1
+            0x000580e7, // jalr ra, 0(a1)
+            0x00012683, // lw   a3, 0(sp)
+            0x30051073, // csrrw zero, mstatus, a0
+        };
+        static const unsigned kWeights[] = {40, 30, 15, 14, 1};
+        std::mt19937 rng(1234);
+        std::discrete_distribution<int> pick(std::begin(kWeights), std::end(kWeights));
+        ASSERT_EQ(rv_rawtrace_open(m_trace.c_str()), 0);
+        for (size_t i = 0; i < kRecords; i++) {
+            uint32_t inst = kInsts[pick(rng)];
+            int rd, rs1, rs2, csr;
+            rv_decode_fields(inst, &rd, &rs1, &rs2, &csr);
+            m_insts.push_back(inst);
+            rv_rawtrace_put(0, 2 * i, 0x80000000 + 4 * i, inst, (rd > 0) ? rd : 0, i);
+        }
+        rv_rawtrace_close();
+        ASSERT_EQ(Run(g_indexTool + " " + m_trace + " " + m_index), 0);
+    }
+    void TearDown() override {
+        rv_reset_options();
+        std::remove(m_trace.c_str());
+        std::remove(m_index.c_str());
+    }
+
+    static int Run(const std::string& cmd, std::string* out = nullptr) {
+        FILE* pipe = popen((cmd + " 2>/dev/null").c_str(), "r");
+        if (pipe == nullptr) {
+            return -1;
+        }
+        char buf[512];
+        while (fgets(buf, sizeof(buf), pipe) != nullptr) {
+            if (out != nullptr) {
+                *out += buf;
+            }
+        }
+        int status = pclose(pipe);
+        return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    }
+
+    // Record indices rv-tracequery prints for terms.
+    std::vector<size_t> Query(const std::string& terms) {
+        std::string out;
+        EXPECT_EQ(Run(g_queryTool + " " + m_trace + " " + m_index + " " + terms, &out), 0) << terms;
+        std::vector<size_t> found;
+        size_t lineStart = 0;
+        while (lineStart < out.size()) {
+            size_t idx = 0;
+            EXPECT_EQ(sscanf(out.c_str() + lineStart + 1, "%zu", &idx), 1);
+            found.push_back(idx);
+            size_t nl = out.find('\n', lineStart);
+            lineStart = (nl == std::string::npos) ? out.size() : nl + 1;
+        }
+        return found;
+    }
+
+    // The same thing by checking every record.
+    std::vector<size_t> Scan(const std::vector<TermCheck>& terms, uint64_t cycleFrom = 0,
+                             uint64_t cycleTo = UINT64_MAX) {
+        std::vector<size_t> found;
+        for (size_t i = 0; i < m_insts.size(); i++) {
+            int rd, rs1, rs2, csr;
+            int op = rv_decode_fields(m_insts[i], &rd, &rs1, &rs2, &csr);
+            bool match = (2 * i >= cycleFrom && 2 * i < cycleTo);
+            for (const TermCheck& term : terms) {
+                if (strcmp(term.key, "op") == 0) {
+                    match = match && op == term.value;
+                } else if (strcmp(term.key, "rd") == 0) {
+                    match = match && rd == term.value;
+                } else if (strcmp(term.key, "rs") == 0) {
+                    match = match && (rs1 == term.value || rs2 == term.value);
+                } else {
+                    match = match && csr == term.value;
+                }
+            }
+            if (match) {
+                found.push_back(i);
+            }
+        }
+        return found;
+    }
+
+    std::string           m_trace;
+    std::string           m_index;
+    std::vector<uint32_t> m_insts;
+};
+
+TEST_F(TraceIndexTools, SingleTerm) {
+    std::vector<size_t> jalr = Scan({{"op", rv_opcode_id_by_name("jalr")}});
+    ASSERT_GT(jalr.size(), 100u);
+    EXPECT_EQ(Query("op=jalr"), jalr);
+    EXPECT_EQ(Query("rd=ra"), Scan({{"rd", 1}}));
+    EXPECT_EQ(Query("rs=sp"), Scan({{"rs", 2}}));
+    EXPECT_EQ(Query("csr=0x300"), Scan({{"csr", 0x300}}));
+}
+
+TEST_F(TraceIndexTools, Intersections) {
+    int addi = rv_opcode_id_by_name("addi");
+    int csrrw = rv_opcode_id_by_name("csrrw");
+    std::vector<size_t> rare = Scan({{"op", csrrw}, {"rs", 10}});
+    ASSERT_GT(rare.size(), 10u);
+    EXPECT_EQ(Query("op=csrrw rs=a0"), rare);
+    EXPECT_EQ(Query("rs=a0 csr=0x300 op=csrrw"), rare); // Order doesn't matter
+    EXPECT_EQ(Query("op=addi rd=a0 rs=a0"), Scan({{"op", addi}, {"rd", 10}, {"rs", 10}}));
+    EXPECT_EQ(Query("rs=a0 rs=a1"), Scan({{"rs", 10}, {"rs", 11}}));
+}
+
+TEST_F(TraceIndexTools, EmptyAndDisjoint) {
+    // Never occurs: no list at all.
+    EXPECT_TRUE(Query("op=sub").empty());
+    EXPECT_TRUE(Query("op=addi op=sub").empty());
+    EXPECT_TRUE(Query("csr=0x301 rs=a0").empty());
+    // Both lists are long but share nothing.
+    EXPECT_TRUE(Query("op=jalr op=lw").empty());
+    EXPECT_TRUE(Query("op=addi rd=a2").empty());
+    EXPECT_TRUE(Query("rd=a3 rs=a0").empty());
+}
+
+TEST_F(TraceIndexTools, CycleRanges) {
+    int add = rv_opcode_id_by_name("add");
+    EXPECT_EQ(Query("op=add cycles=1000:3001"), Scan({{"op", add}}, 1000, 3001));
+    EXPECT_EQ(Query("cycles=9990:20000"), Scan({}, 9990, 20000));
+    EXPECT_TRUE(Query("op=add cycles=20000:30000").empty());
+
+    std::string out;
+    EXPECT_EQ(Run(g_queryTool + " -c " + m_trace + " " + m_index + " op=add", &out), 0);
+    EXPECT_EQ(out, std::to_string(Scan({{"op", add}}).size()) + "\n");
+}
+
+TEST_F(TraceIndexTools, BadQueries) {
+    std::string base = g_queryTool + " " + m_trace + " " + m_index + " ";
+    EXPECT_NE(Run(base + "op=bogus"), 0);
+    EXPECT_NE(Run(base + "rd=x32"), 0);
+    EXPECT_NE(Run(base + "csr=4096"), 0);
+    EXPECT_NE(Run(base + "cycles=5:1"), 0);
+    EXPECT_NE(Run(base + "cycles=5:-1"), 0);
+    EXPECT_NE(Run(base + "cycles=-5:10"), 0);
+    EXPECT_NE(Run(base + "cycles=5:"), 0);
+    EXPECT_NE(Run(base + "cycles=x"), 0);
+    EXPECT_NE(Run(base + "csr=-0"), 0);
+    EXPECT_NE(Run(base + "pc=0"), 0);
+    EXPECT_NE(Run(g_indexTool + " /nonexistent/trace.rvt " + m_index), 0);
+}
+
+TEST_F(TraceIndexTools, Validation) {
+    TraceIndex index;
+    ASSERT_EQ(trace_index_open(m_index.c_str(), &index), 0);
+    EXPECT_EQ(index.hdr->traceRecords, kRecords);
+    trace_index_close(&index);
+
+    std::string image;
+    {
+        std::ifstream in(m_index, std::ios::binary);
+        image.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    ASSERT_GT(image.size(), sizeof(TraceIndexHeader) + sizeof(TraceIndexList));
+    auto check = [&](const std::string& bytes) {
+        {
+            std::ofstream out(m_index, std::ios::binary);
+            out.write(bytes.data(), bytes.size());
+        }
+        TraceIndex idx;
+        int err = trace_index_open(m_index.c_str(), &idx);
+        trace_index_close(&idx);
+        return err;
+    };
+    EXPECT_EQ(check(image), 0);
+    EXPECT_NE(check(image.substr(0, sizeof(TraceIndexHeader) - 1)), 0);
+
+    std::string bad = image;
+    bad[0] ^= 1; // Magic
+    EXPECT_NE(check(bad), 0);
+    bad = image;
+    bad[offsetof(TraceIndexHeader, version)]++;
+    EXPECT_NE(check(bad), 0);
+    // Lists that run past the end of the file
+    EXPECT_NE(check(image.substr(0, image.size() - 4)), 0);
+    EXPECT_NE(check(image.substr(0, sizeof(TraceIndexHeader) + 4)), 0);
+
+    // Postings past the end of the trace, or out of order, in a file that
+    // otherwise checks out.
+    TraceIndexHeader hdr;
+    memcpy(&hdr, image.data(), sizeof(hdr));
+    TraceIndexList first;
+    memcpy(&first, image.data() + sizeof(hdr), sizeof(first));
+    ASSERT_GE(first.count, 2u);
+    size_t postings = sizeof(hdr) + hdr.numLists * sizeof(TraceIndexList) + first.offset * sizeof(uint32_t);
+    auto withPosting = [&](size_t n, uint32_t value) {
+        std::string out = image;
+        memcpy(&out[postings + n * sizeof(uint32_t)], &value, sizeof(value));
+        return out;
+    };
+    uint32_t second;
+    memcpy(&second, image.data() + postings + sizeof(uint32_t), sizeof(second));
+    EXPECT_NE(check(withPosting(0, kRecords)), 0);
+    EXPECT_NE(check(withPosting(0, UINT32_MAX)), 0);
+    EXPECT_NE(check(withPosting(0, second)), 0);     // Repeated
+    EXPECT_NE(check(withPosting(0, second + 1)), 0); // Descending
+    ASSERT_NE(check(withPosting(first.count - 1, kRecords)), 0);
+    EXPECT_NE(Run(g_queryTool + " " + m_trace + " " + m_index + " op=addi"), 0);
+
+    // Intact, but built for a different trace.
+    EXPECT_EQ(check(image), 0);
+    ASSERT_EQ(rv_rawtrace_open(m_trace.c_str()), 0);
+    rv_rawtrace_put(0, 0, 0x80000000, 0x00150513, 10, 1);
+    rv_rawtrace_close();
+    EXPECT_NE(Run(g_queryTool + " " + m_trace + " " + m_index + " op=addi"), 0);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  if (argc > 2) {
+      g_indexTool = argv[1];
+      g_queryTool = argv[2];
+  }
+  return RUN_ALL_TESTS();
+}
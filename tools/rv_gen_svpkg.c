@@ -0,0 +1,102 @@
+//  SPDX-FileCopyrightText: 2022 Jake Merdich <jake@merdich.com>
+//  SPDX-License-Identifier: Unlicense
+
+// Generates rv_decode_pkg.sv from the library's opcode table (through
+// rv_opcode_count/name/pattern): an opcode-ID enum, a casez decode function
+// and a packed mnemonic lookup, all synthesizable, for runs that can't afford
+// a DPI call per instruction.
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "rv_disass.h"
+
+// RV_OP_FENCE_I for "fence.i"
+static void print_enum_name(FILE* out, const char* name) {
+    fputs("RV_OP_", out);
+    for (; *name != 0; name++) {
+        fputc(isalnum((unsigned char)*name) ? toupper((unsigned char)*name) : '_', out);
+    }
+}
+
+// Bits the opcode doesn't care about become '?', split at the R-type fields.
+static void print_pattern(FILE* out, int id) {
+    unsigned int match = 0;
+    unsigned int mask = 0;
+    rv_opcode_pattern(id, &match, &mask);
+    static const int FieldEnds[] = {25, 20, 15, 12, 7};
+    fputs("32'b", out);
+    int field = 0;
+    for (int bit = 31; bit >= 0; bit--) {
+        if (field < 5 && bit == FieldEnds[field] - 1) {
+            fputc('_', out);
+            field++;
+        }
+        uint32_t m = 1u << bit;
+        fputc((mask & m) ? ((match & m) ? '1' : '0') : '?', out);
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <rv_decode_pkg.sv>\n", argv[0]);
+        return 1;
+    }
+    FILE* out = fopen(argv[1], "w");
+    if (out == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    fputs("// Generated by rv-gen-svpkg from UncompressedInsts in rv_disass.c. Do not edit.\n"
+          "// Enum values are the same opcode IDs rv_opcode_id() returns.\n"
+          "package rv_decode_pkg;\n"
+          "\n"
+          "typedef enum int {\n"
+          "    RV_OP_INVALID = -1",
+          out);
+    for (int i = 0; i < rv_opcode_count(); i++) {
+        fputs(",\n    ", out);
+        print_enum_name(out, rv_opcode_name(i));
+        fprintf(out, " = %d", i);
+    }
+    fputs("\n} rv_op_e;\n"
+          "\n"
+          "function automatic rv_op_e rv_decode(input logic [31:0] inst);\n"
+          "    priority casez (inst)\n",
+          out);
+    for (int i = 0; i < rv_opcode_count(); i++) {
+        fputs("        ", out);
+        print_pattern(out, i);
+        fputs(": rv_decode = ", out);
+        print_enum_name(out, rv_opcode_name(i));
+        fputs(";\n", out);
+    }
+    fputs("        default: rv_decode = RV_OP_INVALID;\n"
+          "    endcase\n"
+          "endfunction\n"
+          "\n"
+          "// Right-aligned ASCII; use string'(rv_op_mnemonic(op)) in simulation.\n"
+          "function automatic logic [63:0] rv_op_mnemonic(input rv_op_e op);\n"
+          "    case (op)\n",
+          out);
+    for (int i = 0; i < rv_opcode_count(); i++) {
+        fputs("        ", out);
+        print_enum_name(out, rv_opcode_name(i));
+        fprintf(out, ": rv_op_mnemonic = \"%s\";\n", rv_opcode_name(i));
+    }
+    fputs("        default: rv_op_mnemonic = \"unknown\";\n"
+          "    endcase\n"
+          "endfunction\n"
+          "\n"
+          "endpackage\n",
+          out);
+
+    if (fclose(out) != 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    return 0;
+}
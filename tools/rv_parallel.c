@@ -0,0 +1,419 @@
+//  SPDX-FileCopyrightText: 2022 Jake Merdich <jake@merdich.com>
+//  SPDX-License-Identifier: Unlicense
+
+#ifdef __linux__
+#define _GNU_SOURCE // sched_getaffinity and friends
+#include <sched.h>
+#endif
+
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "rv_parallel.h"
+
+#define DEFAULT_CHUNK_SIZE        8192 // Makes sense for per-inst work
+#define DEFAULT_WINDOW_PER_THREAD 4
+#define PROGRESS_INTERVAL_NS      250000000
+
+struct RvParallelOut {
+    char*  data;
+    size_t len;
+    size_t cap;
+};
+
+typedef struct {
+    RvParallelOut out;
+    bool          done; // Finished, waiting for the chunks before it
+} OutSlot;
+
+// Chunks [lo, hi) a worker still has to run. The owner pops from lo, thieves
+// take the top half. Padded so neighbouring workers don't share a line.
+typedef struct {
+    mtx_t    lock;
+    uint64_t lo;
+    uint64_t hi;
+    char     pad[64];
+} WorkerSpan;
+
+typedef struct RunState RunState;
+
+typedef struct {
+    RunState* run;
+    unsigned  idx;
+    thrd_t    thread;
+} Worker;
+
+struct RunState {
+    const RvParallelOpts* opts;
+    RvRangeFn             fn;
+    uint64_t              start;
+    uint64_t              end;
+    uint64_t              chunkSize;
+    uint64_t              numChunks;
+    unsigned              numThreads;
+    WorkerSpan*           spans;
+
+    // Chunks nobody has claimed yet start at nextChunk. In ordered mode a
+    // claim must stay within `window` of `emitted`.
+    mtx_t    poolLock;
+    cnd_t    poolCond; // Window moved, run cancelled or a worker exited
+    uint64_t nextChunk;
+    uint64_t emitted;
+    bool     emitting;
+    OutSlot* slots;    // window of them, indexed by chunk % window
+    uint64_t window;
+    unsigned liveWorkers;
+
+    atomic_uint_fast64_t chunksDone;
+    atomic_int           cancelResult;
+
+    int*     cpus;
+    unsigned numCpus;
+};
+
+void rv_parallel_opts_init(RvParallelOpts* opts) {
+    memset(opts, 0, sizeof(*opts));
+}
+
+int rv_parallel_write(RvParallelOut* out, const void* data, size_t len) {
+    if (out->len + len > out->cap) {
+        size_t cap = out->cap ? out->cap : 256;
+        while (cap < out->len + len) {
+            cap *= 2;
+        }
+        char* grown = (char*)realloc(out->data, cap);
+        if (grown == NULL) {
+            return -1;
+        }
+        out->data = grown;
+        out->cap = cap;
+    }
+    memcpy(out->data + out->len, data, len);
+    out->len += len;
+    return 0;
+}
+
+int rv_parallel_printf(RvParallelOut* out, const char* fmt, ...) {
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (len < 0) {
+        return -1;
+    }
+    if ((size_t)len < sizeof(buf)) {
+        return rv_parallel_write(out, buf, (size_t)len);
+    }
+
+    char* big = (char*)malloc((size_t)len + 1);
+    if (big == NULL) {
+        return -1;
+    }
+    va_start(args, fmt);
+    vsnprintf(big, (size_t)len + 1, fmt, args);
+    va_end(args);
+    int err = rv_parallel_write(out, big, (size_t)len);
+    free(big);
+    return err;
+}
+
+// CPUs this process may run on, in order, for pinning.
+static void rv_parallel_get_cpus(RunState* run) {
+    run->cpus = NULL;
+    run->numCpus = 0;
+#ifdef __linux__
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        return;
+    }
+    run->cpus = (int*)malloc(CPU_SETSIZE * sizeof(int));
+    if (run->cpus == NULL) {
+        return;
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &set)) {
+            run->cpus[run->numCpus++] = cpu;
+        }
+    }
+#endif
+}
+
+static unsigned rv_parallel_default_threads(const RunState* run) {
+    if (run->numCpus > 0) {
+        return run->numCpus;
+    }
+#ifndef _WIN32
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    if (online > 0) {
+        return (unsigned)online;
+    }
+#endif
+    return 1;
+}
+
+static void rv_parallel_pin(const RunState* run, unsigned idx) {
+#ifdef __linux__
+    if (run->opts->pinThreads && run->numCpus > 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(run->cpus[idx % run->numCpus], &set);
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+#else
+    (void)run;
+    (void)idx;
+#endif
+}
+
+static bool span_pop(WorkerSpan* span, uint64_t* chunk) {
+    mtx_lock(&span->lock);
+    bool got = span->lo < span->hi;
+    if (got) {
+        *chunk = span->lo++;
+    }
+    mtx_unlock(&span->lock);
+    return got;
+}
+
+static void span_set(WorkerSpan* span, uint64_t lo, uint64_t hi) {
+    mtx_lock(&span->lock);
+    span->lo = lo;
+    span->hi = hi;
+    mtx_unlock(&span->lock);
+}
+
+// Takes the top half of the nearest worker's span that has any left. Never
+// holds two span locks at once.
+static bool rv_parallel_steal(RunState* run, unsigned idx, uint64_t* chunk) {
+    for (unsigned k = 1; k < run->numThreads; k++) {
+        WorkerSpan* victim = &run->spans[(idx + k) % run->numThreads];
+        mtx_lock(&victim->lock);
+        uint64_t left = victim->hi - victim->lo;
+        uint64_t lo = 0, hi = 0;
+        if (left > 0) {
+            hi = victim->hi;
+            lo = hi - (left + 1) / 2;
+            victim->hi = lo;
+        }
+        mtx_unlock(&victim->lock);
+        if (left > 0) {
+            *chunk = lo;
+            span_set(&run->spans[idx], lo + 1, hi);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Claims a fresh span from the pool, waiting for the window to move if the
+// run is ordered and too far ahead. False once there's nothing left.
+static bool rv_parallel_refill(RunState* run, unsigned idx, uint64_t* chunk) {
+    mtx_lock(&run->poolLock);
+    for (;;) {
+        if (atomic_load(&run->cancelResult) != 0 || run->nextChunk >= run->numChunks) {
+            mtx_unlock(&run->poolLock);
+            return false;
+        }
+        uint64_t limit = run->numChunks;
+        if (run->slots != NULL && run->emitted + run->window < limit) {
+            limit = run->emitted + run->window;
+        }
+        if (run->nextChunk < limit) {
+            uint64_t grain = (limit - run->nextChunk) / run->numThreads;
+            if (grain == 0) {
+                grain = 1;
+            }
+            *chunk = run->nextChunk;
+            run->nextChunk += grain;
+            mtx_unlock(&run->poolLock);
+            span_set(&run->spans[idx], *chunk + 1, *chunk + grain);
+            return true;
+        }
+        cnd_wait(&run->poolCond, &run->poolLock);
+    }
+}
+
+// Marks a chunk's output ready and, if nobody else is already at it, emits
+// every ready chunk at the front of the window. The callback runs unlocked;
+// its slot can't be reused until `emitted` moves past it.
+static void rv_parallel_complete(RunState* run, uint64_t chunk) {
+    mtx_lock(&run->poolLock);
+    run->slots[chunk % run->window].done = true;
+    if (!run->emitting) {
+        run->emitting = true;
+        for (;;) {
+            OutSlot* slot = &run->slots[run->emitted % run->window];
+            if (!slot->done) {
+                break;
+            }
+            mtx_unlock(&run->poolLock);
+            run->opts->emit(run->opts->ctx, slot->out.data, slot->out.len);
+            mtx_lock(&run->poolLock);
+            slot->done = false;
+            slot->out.len = 0;
+            run->emitted++;
+            cnd_broadcast(&run->poolCond);
+        }
+        run->emitting = false;
+    }
+    mtx_unlock(&run->poolLock);
+}
+
+static int rv_parallel_worker(void* arg) {
+    Worker* worker = (Worker*)arg;
+    RunState* run = worker->run;
+    rv_parallel_pin(run, worker->idx);
+
+    uint64_t chunk;
+    while (atomic_load(&run->cancelResult) == 0 &&
+           (span_pop(&run->spans[worker->idx], &chunk) ||
+            rv_parallel_steal(run, worker->idx, &chunk) ||
+            rv_parallel_refill(run, worker->idx, &chunk))) {
+        uint64_t begin = run->start + chunk * run->chunkSize;
+        uint64_t end = (run->end - begin > run->chunkSize) ? begin + run->chunkSize : run->end;
+        RvParallelOut* out = (run->slots != NULL) ? &run->slots[chunk % run->window].out : NULL;
+
+        int result = run->fn(run->opts->ctx, begin, end, out);
+        if (result != 0) {
+            int expected = 0;
+            atomic_compare_exchange_strong(&run->cancelResult, &expected, result);
+            break;
+        }
+        atomic_fetch_add(&run->chunksDone, 1);
+        if (out != NULL) {
+            rv_parallel_complete(run, chunk);
+        }
+    }
+
+    mtx_lock(&run->poolLock);
+    run->liveWorkers--;
+    cnd_broadcast(&run->poolCond);
+    mtx_unlock(&run->poolLock);
+    return 0;
+}
+
+// When the next progress report is due.
+static void rv_progress_deadline(struct timespec* deadline) {
+    timespec_get(deadline, TIME_UTC);
+    deadline->tv_nsec += PROGRESS_INTERVAL_NS;
+    if (deadline->tv_nsec >= 1000000000) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000;
+    }
+}
+
+int rv_parallel_run(uint64_t start, uint64_t end, const RvParallelOpts* opts, RvRangeFn fn) {
+    if (end <= start) {
+        return 0;
+    }
+
+    RunState run;
+    memset(&run, 0, sizeof(run));
+    run.opts = opts;
+    run.fn = fn;
+    run.start = start;
+    run.end = end;
+    run.chunkSize = opts->chunkSize ? opts->chunkSize : DEFAULT_CHUNK_SIZE;
+    run.numChunks = (end - start - 1) / run.chunkSize + 1; // Divide, rounding up.
+    rv_parallel_get_cpus(&run);
+    run.numThreads = opts->numThreads ? opts->numThreads : rv_parallel_default_threads(&run);
+    if ((uint64_t)run.numThreads > run.numChunks) {
+        run.numThreads = (unsigned)run.numChunks;
+    }
+    run.window = opts->window ? opts->window : (uint64_t)DEFAULT_WINDOW_PER_THREAD * run.numThreads;
+    atomic_init(&run.chunksDone, 0);
+    atomic_init(&run.cancelResult, 0);
+
+    run.spans = (WorkerSpan*)calloc(run.numThreads, sizeof(WorkerSpan));
+    Worker* workers = (Worker*)calloc(run.numThreads, sizeof(Worker));
+    if (opts->emit != NULL) {
+        run.slots = (OutSlot*)calloc(run.window, sizeof(OutSlot));
+    }
+    // Whatever got initialized is torn down at the end, even if a later
+    // step failed.
+    bool ok = run.spans != NULL && workers != NULL && (opts->emit == NULL || run.slots != NULL);
+    bool haveLock = ok && mtx_init(&run.poolLock, mtx_plain) == thrd_success;
+    bool haveCond = haveLock && cnd_init(&run.poolCond) == thrd_success;
+    ok = haveCond;
+
+    // Deal the first window (or everything, if unordered) out evenly; the
+    // rest goes to whoever runs dry first.
+    uint64_t dealt = (run.slots != NULL && run.window < run.numChunks) ? run.window : run.numChunks;
+    unsigned spanLocks = 0;
+    for (unsigned i = 0; ok && i < run.numThreads; i++) {
+        ok = mtx_init(&run.spans[i].lock, mtx_plain) == thrd_success;
+        spanLocks += ok ? 1 : 0;
+        run.spans[i].lo = dealt * i / run.numThreads;
+        run.spans[i].hi = dealt * (i + 1) / run.numThreads;
+    }
+    run.nextChunk = dealt;
+
+    unsigned started = 0;
+    for (; ok && started < run.numThreads; started++) {
+        workers[started].run = &run;
+        workers[started].idx = started;
+        mtx_lock(&run.poolLock);
+        run.liveWorkers++;
+        mtx_unlock(&run.poolLock);
+        if (thrd_create(&workers[started].thread, rv_parallel_worker, &workers[started]) != thrd_success) {
+            mtx_lock(&run.poolLock);
+            run.liveWorkers--;
+            mtx_unlock(&run.poolLock);
+            int expected = 0;
+            atomic_compare_exchange_strong(&run.cancelResult, &expected, -1);
+            break;
+        }
+    }
+
+    if (started > 0) {
+        // poolCond also wakes us for every emitted chunk, so only report
+        // once the deadline has actually passed.
+        struct timespec deadline;
+        rv_progress_deadline(&deadline);
+        mtx_lock(&run.poolLock);
+        while (run.liveWorkers > 0) {
+            if (opts->progress == NULL) {
+                cnd_wait(&run.poolCond, &run.poolLock);
+            } else if (cnd_timedwait(&run.poolCond, &run.poolLock, &deadline) == thrd_timedout) {
+                mtx_unlock(&run.poolLock);
+                opts->progress(opts->ctx, atomic_load(&run.chunksDone), run.numChunks);
+                rv_progress_deadline(&deadline);
+                mtx_lock(&run.poolLock);
+            }
+        }
+        mtx_unlock(&run.poolLock);
+    }
+    for (unsigned i = 0; i < started; i++) {
+        thrd_join(workers[i].thread, NULL);
+    }
+
+    int result = ok ? atomic_load(&run.cancelResult) : -1;
+    for (unsigned i = 0; i < spanLocks; i++) {
+        mtx_destroy(&run.spans[i].lock);
+    }
+    if (haveCond) {
+        cnd_destroy(&run.poolCond);
+    }
+    if (haveLock) {
+        mtx_destroy(&run.poolLock);
+    }
+    if (run.slots != NULL) {
+        for (uint64_t i = 0; i < run.window; i++) {
+            free(run.slots[i].out.data);
+        }
+    }
+    free(run.slots);
+    free(workers);
+    free(run.spans);
+    free(run.cpus);
+    return result;
+}
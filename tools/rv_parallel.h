@@ -0,0 +1,63 @@
+//  SPDX-FileCopyrightText: 2022 Jake Merdich <jake@merdich.com>
+//  SPDX-License-Identifier: Unlicense
+
+#ifndef RV_PARALLEL_H
+#define RV_PARALLEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Parallel map over an index range, for the bulk tools and the exhaustive
+// tests. The range is cut into chunks; each worker owns a span of chunks and
+// steals half of a neighbour's span when it runs dry. With an emit callback,
+// each chunk's output is buffered and handed over in range order, and workers
+// never run more than `window` chunks ahead of the oldest unemitted one.
+
+// Per-chunk output buffer, see rv_parallel_write.
+typedef struct RvParallelOut RvParallelOut;
+
+// Runs indices [begin, end). `out` is NULL unless the run has an emit
+// callback. Return nonzero to cancel the whole run.
+typedef int (*RvRangeFn)(void* ctx, uint64_t begin, uint64_t end, RvParallelOut* out);
+// Gets each chunk's output in range order, from one thread at a time.
+typedef void (*RvEmitFn)(void* ctx, const char* data, size_t len);
+// Called from the thread that started the run, a few times a second.
+typedef void (*RvProgressFn)(void* ctx, uint64_t chunksDone, uint64_t numChunks);
+
+typedef struct {
+    unsigned     numThreads; // 0: one per CPU we may run on
+    uint64_t     chunkSize;  // Indices per chunk, 0: 8192
+    unsigned     window;     // Buffered chunks when ordered, 0: 4 per thread
+    bool         pinThreads; // Pin worker i to the i-th allowed CPU, so
+                             // neighbouring workers (who steal from each
+                             // other first) share a node and its memory.
+    RvEmitFn     emit;       // NULL: unordered, nothing buffered
+    RvProgressFn progress;   // Optional
+    void*        ctx;        // Passed to all of the above
+} RvParallelOpts;
+
+void rv_parallel_opts_init(RvParallelOpts* opts);
+
+// Returns 0 once everything ran, the first nonzero value a chunk returned if
+// the run was cancelled, or -1 if it couldn't start. After a cancel, output is
+// emitted up to the first chunk that didn't finish.
+int rv_parallel_run(uint64_t start, uint64_t end, const RvParallelOpts* opts, RvRangeFn fn);
+
+// Appends to a chunk's output. Returns 0, or -1 if out of memory.
+int rv_parallel_write(RvParallelOut* out, const void* data, size_t len);
+int rv_parallel_printf(RvParallelOut* out, const char* fmt, ...)
+#ifdef __GNUC__
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
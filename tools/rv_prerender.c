@@ -0,0 +1,59 @@
+//  SPDX-FileCopyrightText: 2022 Jake Merdich <jake@merdich.com>
+//  SPDX-License-Identifier: Unlicense
+
+// Renders a $readmemh (or raw binary) ROM image into a sidecar that
+// rv_rom_load() maps and rv_disass_at() serves lookups from.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rv_disass.h"
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [-b] [-p] [-n] [-l] <image> <base> <sidecar>\n"
+            "  -b  image is raw little-endian binary instead of memh\n"
+            "  -p  render with UsePseudoInsts\n"
+            "  -n  render with NoAbiNames\n"
+            "  -l  render with LlvmStyle\n"
+            "Options must match what the simulation sets, or lookups fall\n"
+            "back to live disassembly.\n",
+            argv0);
+}
+
+int main(int argc, char** argv) {
+    char isBinary = 0;
+    int argi = 1;
+    for (; argi < argc && argv[argi][0] == '-' && argv[argi][1] != 0; argi++) {
+        if (strcmp(argv[argi], "-b") == 0) {
+            isBinary = 1;
+        } else if (strcmp(argv[argi], "-p") == 0) {
+            rv_set_option("UsePseudoInsts", 1);
+        } else if (strcmp(argv[argi], "-n") == 0) {
+            rv_set_option("NoAbiNames", 1);
+        } else if (strcmp(argv[argi], "-l") == 0) {
+            rv_set_option("LlvmStyle", 1);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - argi != 3) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    char* end = NULL;
+    unsigned long base = strtoul(argv[argi + 1], &end, 0);
+    if (*end != 0) {
+        fprintf(stderr, "bad base address '%s'\n", argv[argi + 1]);
+        return 1;
+    }
+
+    if (rv_rom_prerender(argv[argi], (unsigned int)base, isBinary, argv[argi + 2]) != 0) {
+        fprintf(stderr, "failed to render '%s' into '%s'\n", argv[argi], argv[argi + 2]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,96 @@
+//  SPDX-FileCopyrightText: 2022 Jake Merdich <jake@merdich.com>
+//  SPDX-License-Identifier: Unlicense
+
+// Lockstep comparison of two raw retire traces (say, a core and its reference
+// model). Matching records are compared as raw bytes and never formatted; the
+// disassembler only runs for the context window around the first divergence.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace_map.h"
+
+#define MAX_CONTEXT 1000000
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [-C lines] [-p] [-n] <dut.rvt> <ref.rvt>\n"
+            "  -C  records of context around the divergence (default 5, at most 1000000)\n"
+            "  -p  disassemble with UsePseudoInsts\n"
+            "  -n  disassemble with NoAbiNames\n"
+            "Exits 0 if the traces match, 1 if they diverge, 2 on errors.\n",
+            argv0);
+}
+
+int main(int argc, char** argv) {
+    size_t context = 5;
+    int argi = 1;
+    for (; argi < argc && argv[argi][0] == '-'; argi++) {
+        if (strcmp(argv[argi], "-C") == 0 && argi + 1 < argc) {
+            unsigned long long lines;
+            const char* end = trace_parse_number(argv[++argi], MAX_CONTEXT, &lines);
+            if (end == NULL || *end != 0) {
+                usage(argv[0]);
+                return 2;
+            }
+            context = (size_t)lines;
+        } else if (strcmp(argv[argi], "-p") == 0) {
+            rv_set_option("UsePseudoInsts", 1);
+        } else if (strcmp(argv[argi], "-n") == 0) {
+            rv_set_option("NoAbiNames", 1);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (argc - argi != 2) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    TraceMap dut;
+    TraceMap ref;
+    if (trace_map_open(argv[argi], &dut) != 0) {
+        return 2;
+    }
+    if (trace_map_open(argv[argi + 1], &ref) != 0) {
+        trace_map_close(&dut);
+        return 2;
+    }
+
+    size_t common = (dut.count < ref.count) ? dut.count : ref.count;
+    size_t at = trace_first_mismatch(dut.records, ref.records, common);
+    if (at == common && dut.count == ref.count) {
+        printf("traces match (%zu records)\n", common);
+        trace_map_close(&dut);
+        trace_map_close(&ref);
+        return 0;
+    }
+
+    if (at < common) {
+        printf("traces diverge at record %zu (dut cycle %llu, ref cycle %llu)\n", at,
+               (unsigned long long)dut.records[at].cycle,
+               (unsigned long long)ref.records[at].cycle);
+    } else {
+        printf("%s trace ends at record %zu\n", (dut.count < ref.count) ? "dut" : "ref", at);
+    }
+
+    size_t first = (at > context) ? at - context : 0;
+    for (size_t i = first; i < at; i++) {
+        trace_print_record(stdout, ' ', i, &dut.records[i]);
+    }
+    for (size_t i = at; i <= at + context && (i < dut.count || i < ref.count); i++) {
+        if (i < dut.count) {
+            trace_print_record(stdout, '<', i, &dut.records[i]);
+        }
+        if (i < ref.count) {
+            trace_print_record(stdout, '>', i, &ref.records[i]);
+        }
+    }
+
+    trace_map_close(&dut);
+    trace_map_close(&ref);
+    return 1;
+}
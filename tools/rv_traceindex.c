@@ -0,0 +1,212 @@
+//  SPDX-FileCopyrightText: 2022 Jake Merdich <jake@merdich.com>
+//  SPDX-License-Identifier: Unlicense
+
+// Builds an inverted index over a raw trace: for every opcode, destination
+// register, source register and CSR, the list of records that use it. Records
+// are decoded in parallel chunks and the lists are appended in trace order, so
+// they come out sorted. rv-tracequery answers queries from the index.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rv_parallel.h"
+#include "trace_map.h"
+
+// Posting lists are kept in one flat array of slots, in key order.
+#define SLOT_OP   0
+#define SLOT_RD   (SLOT_OP + 256)
+#define SLOT_RS   (SLOT_RD + 32)
+#define SLOT_CSR  (SLOT_RS + 32)
+#define NUM_SLOTS (SLOT_CSR + 4096)
+
+typedef struct {
+    uint32_t* idx;
+    uint64_t  count;
+    uint64_t  cap;
+} Postings;
+
+// What a chunk hands back per record; -1 for fields the inst doesn't have.
+typedef struct {
+    int16_t op;
+    int8_t  rd;
+    int8_t  rs1;
+    int8_t  rs2;
+    int8_t  pad;
+    int16_t csr;
+} DecodedRecord;
+
+typedef struct {
+    const TraceMap* trace;
+    Postings*       slots;
+    int             outOfMemory;
+} IndexBuild;
+
+static uint32_t slot_key(uint32_t slot) {
+    if (slot >= SLOT_CSR) {
+        return INDEX_KEY(IndexKey_Csr, slot - SLOT_CSR);
+    } else if (slot >= SLOT_RS) {
+        return INDEX_KEY(IndexKey_Rs, slot - SLOT_RS);
+    } else if (slot >= SLOT_RD) {
+        return INDEX_KEY(IndexKey_Rd, slot - SLOT_RD);
+    }
+    return INDEX_KEY(IndexKey_Op, slot - SLOT_OP);
+}
+
+static int postings_add(Postings* list, uint32_t idx) {
+    if (list->count == list->cap) {
+        uint64_t cap = list->cap ? list->cap * 2 : 64;
+        uint32_t* grown = (uint32_t*)realloc(list->idx, cap * sizeof(*grown));
+        if (grown == NULL) {
+            return -1;
+        }
+        list->idx = grown;
+        list->cap = cap;
+    }
+    list->idx[list->count++] = idx;
+    return 0;
+}
+
+// Runs on the workers: the decode, which is the expensive part.
+static int decode_chunk(void* ctx, uint64_t begin, uint64_t end, RvParallelOut* out) {
+    const IndexBuild* build = (const IndexBuild*)ctx;
+    if (rv_parallel_write(out, &begin, sizeof(begin)) != 0) {
+        return 1;
+    }
+    for (uint64_t i = begin; i < end; i++) {
+        int rd, rs1, rs2, csr;
+        DecodedRecord dec;
+        dec.op = (int16_t)rv_decode_fields(build->trace->records[i].inst, &rd, &rs1, &rs2, &csr);
+        dec.rd = (int8_t)rd;
+        dec.rs1 = (int8_t)rs1;
+        dec.rs2 = (int8_t)rs2;
+        dec.pad = 0;
+        dec.csr = (int16_t)csr;
+        if (rv_parallel_write(out, &dec, sizeof(dec)) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Runs in trace order, one chunk at a time.
+static void append_chunk(void* ctx, const char* data, size_t len) {
+    IndexBuild* build = (IndexBuild*)ctx;
+    uint64_t begin;
+    memcpy(&begin, data, sizeof(begin));
+    const DecodedRecord* decoded = (const DecodedRecord*)(data + sizeof(begin));
+    size_t count = (len - sizeof(begin)) / sizeof(DecodedRecord);
+
+    int err = 0;
+    for (size_t i = 0; i < count; i++) {
+        const DecodedRecord* dec = &decoded[i];
+        uint32_t idx = (uint32_t)(begin + i);
+        if (dec->op < 0) {
+            continue;
+        }
+        err |= postings_add(&build->slots[SLOT_OP + dec->op], idx);
+        if (dec->rd >= 0) {
+            err |= postings_add(&build->slots[SLOT_RD + dec->rd], idx);
+        }
+        if (dec->rs1 >= 0) {
+            err |= postings_add(&build->slots[SLOT_RS + dec->rs1], idx);
+        }
+        if (dec->rs2 >= 0 && dec->rs2 != dec->rs1) {
+            err |= postings_add(&build->slots[SLOT_RS + dec->rs2], idx);
+        }
+        if (dec->csr >= 0) {
+            err |= postings_add(&build->slots[SLOT_CSR + dec->csr], idx);
+        }
+    }
+    if (err != 0) {
+        build->outOfMemory = 1;
+    }
+}
+
+static int write_index(const char* path, const TraceMap* trace, const Postings* slots) {
+    FILE* out = fopen(path, "wb");
+    if (out == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    TraceIndexHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = RV_INDEX_MAGIC;
+    hdr.version = RV_INDEX_VERSION;
+    hdr.traceRecords = trace->count;
+    for (uint32_t slot = 0; slot < NUM_SLOTS; slot++) {
+        hdr.numLists += (slots[slot].count != 0);
+    }
+    int ok = fwrite(&hdr, sizeof(hdr), 1, out) == 1;
+
+    uint64_t offset = 0;
+    for (uint32_t slot = 0; ok && slot < NUM_SLOTS; slot++) {
+        if (slots[slot].count == 0) {
+            continue;
+        }
+        TraceIndexList list;
+        memset(&list, 0, sizeof(list));
+        list.key = slot_key(slot);
+        list.offset = offset;
+        list.count = slots[slot].count;
+        ok = fwrite(&list, sizeof(list), 1, out) == 1;
+        offset += list.count;
+    }
+    for (uint32_t slot = 0; ok && slot < NUM_SLOTS; slot++) {
+        ok = fwrite(slots[slot].idx, sizeof(uint32_t), slots[slot].count, out) == slots[slot].count;
+    }
+
+    if (fclose(out) != 0 || !ok) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <trace.rvt> <index.rvi>\n", argv[0]);
+        return 1;
+    }
+
+    TraceMap trace;
+    if (trace_map_open(argv[1], &trace) != 0) {
+        return 1;
+    }
+    if (trace.count > UINT32_MAX) {
+        fprintf(stderr, "%s: too many records to index\n", argv[1]);
+        trace_map_close(&trace);
+        return 1;
+    }
+
+    IndexBuild build;
+    build.trace = &trace;
+    build.slots = (Postings*)calloc(NUM_SLOTS, sizeof(Postings));
+    build.outOfMemory = 0;
+
+    RvParallelOpts opts;
+    rv_parallel_opts_init(&opts);
+    opts.chunkSize = 65536;
+    opts.emit = append_chunk;
+    opts.ctx = &build;
+    // decode_chunk only fails when its output can't grow, so any positive
+    // result is out of memory too; -1 means the pool itself never started.
+    int result = (build.slots != NULL) ? rv_parallel_run(0, trace.count, &opts, decode_chunk) : 1;
+    int err = 1;
+    if (result < 0) {
+        fprintf(stderr, "couldn't start worker threads to index %s\n", argv[1]);
+    } else if (result > 0 || build.outOfMemory) {
+        fprintf(stderr, "out of memory indexing %s\n", argv[1]);
+    } else {
+        err = write_index(argv[2], &trace, build.slots);
+    }
+
+    for (uint32_t slot = 0; build.slots != NULL && slot < NUM_SLOTS; slot++) {
+        free(build.slots[slot].idx);
+    }
+    free(build.slots);
+    trace_map_close(&trace);
+    return err ? 1 : 0;
+}
@@ -0,0 +1,193 @@
+//  SPDX-FileCopyrightText: 2022 Jake Merdich <jake@merdich.com>
+//  SPDX-License-Identifier: Unlicense
+
+// Answers queries against a raw trace from its rv-traceindex index: the
+// posting lists of all terms are intersected, and only the records that match
+// are read from the trace and disassembled.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace_map.h"
+
+#define MAX_TERMS 16
+
+typedef struct {
+    const uint32_t* idx;
+    uint64_t        count;
+    uint64_t        pos; // Everything before this is below the current candidate
+} Term;
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [-c] [-p] [-n] <trace.rvt> <index.rvi> <term>...\n"
+            "Prints the records matching every term:\n"
+            "  op=<mnemonic>     e.g. op=jalr\n"
+            "  rd=<reg>          destination register, e.g. rd=ra or rd=x1\n"
+            "  rs=<reg>          either source register\n"
+            "  csr=<number>      e.g. csr=0x300\n"
+            "  cycles=<from>:<to>  only records with from <= cycle < to; this isn't\n"
+            "                    indexed, so on its own it reads the whole trace\n"
+            "  -c  print the number of matches instead\n"
+            "  -p  disassemble with UsePseudoInsts\n"
+            "  -n  disassemble with NoAbiNames\n",
+            argv0);
+}
+
+// Advances term to its first entry >= target: gallop, then binary search.
+static void term_seek(Term* term, uint32_t target) {
+    uint64_t lo = term->pos;
+    uint64_t step = 1;
+    uint64_t hi = lo;
+    while (hi < term->count && term->idx[hi] < target) {
+        lo = hi + 1;
+        hi += step;
+        step *= 2;
+    }
+    if (hi > term->count) {
+        hi = term->count;
+    }
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (term->idx[mid] < target) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    term->pos = lo;
+}
+
+static int compare_terms(const void* a, const void* b) {
+    uint64_t ca = ((const Term*)a)->count;
+    uint64_t cb = ((const Term*)b)->count;
+    return (ca > cb) - (ca < cb);
+}
+
+// Turns one term into its posting list key. Returns 0, or -1 if it's bad.
+static int parse_term(const char* term, uint32_t* key) {
+    const char* eq = strchr(term, '=');
+    if (eq == NULL) {
+        return -1;
+    }
+    const char* value = eq + 1;
+    size_t keyLen = (size_t)(eq - term);
+    int num = -1;
+    if (keyLen == 2 && strncmp(term, "op", 2) == 0) {
+        num = rv_opcode_id_by_name(value);
+        *key = INDEX_KEY(IndexKey_Op, num);
+    } else if (keyLen == 2 && strncmp(term, "rd", 2) == 0) {
+        num = rv_reg_by_name(value);
+        *key = INDEX_KEY(IndexKey_Rd, num);
+    } else if (keyLen == 2 && strncmp(term, "rs", 2) == 0) {
+        num = rv_reg_by_name(value);
+        *key = INDEX_KEY(IndexKey_Rs, num);
+    } else if (keyLen == 3 && strncmp(term, "csr", 3) == 0) {
+        unsigned long long csr;
+        const char* end = trace_parse_number(value, 4095, &csr);
+        num = (end != NULL && *end == 0) ? (int)csr : -1;
+        *key = INDEX_KEY(IndexKey_Csr, num);
+    }
+    return (num < 0) ? -1 : 0;
+}
+
+int main(int argc, char** argv) {
+    int countOnly = 0;
+    int argi = 1;
+    for (; argi < argc && argv[argi][0] == '-'; argi++) {
+        if (strcmp(argv[argi], "-c") == 0) {
+            countOnly = 1;
+        } else if (strcmp(argv[argi], "-p") == 0) {
+            rv_set_option("UsePseudoInsts", 1);
+        } else if (strcmp(argv[argi], "-n") == 0) {
+            rv_set_option("NoAbiNames", 1);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - argi < 3) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    TraceMap trace;
+    TraceIndex index;
+    if (trace_map_open(argv[argi], &trace) != 0) {
+        return 1;
+    }
+    if (trace_index_open(argv[argi + 1], &index) != 0) {
+        trace_map_close(&trace);
+        return 1;
+    }
+    int err = 0;
+    if (index.hdr->traceRecords != trace.count) {
+        fprintf(stderr, "%s doesn't match %s; rebuild it with rv-traceindex\n", argv[argi + 1], argv[argi]);
+        err = 1;
+    }
+
+    Term terms[MAX_TERMS];
+    size_t numTerms = 0;
+    unsigned long long cycleFrom = 0;
+    unsigned long long cycleTo = UINT64_MAX;
+    for (int i = argi + 2; !err && i < argc; i++) {
+        uint32_t key;
+        if (strncmp(argv[i], "cycles=", 7) == 0) {
+            const char* end = trace_parse_number(argv[i] + 7, UINT64_MAX, &cycleFrom);
+            if (end != NULL && *end == ':') {
+                end = trace_parse_number(end + 1, UINT64_MAX, &cycleTo);
+            }
+            if (end == NULL || *end != 0 || cycleTo < cycleFrom) {
+                fprintf(stderr, "bad term '%s'\n", argv[i]);
+                err = 1;
+            }
+        } else if (parse_term(argv[i], &key) != 0) {
+            fprintf(stderr, "bad term '%s'\n", argv[i]);
+            err = 1;
+        } else if (numTerms == MAX_TERMS) {
+            fprintf(stderr, "too many terms\n");
+            err = 1;
+        } else {
+            terms[numTerms].idx = trace_index_find(&index, key, &terms[numTerms].count);
+            terms[numTerms].pos = 0;
+            numTerms++;
+        }
+    }
+
+    // Walk the shortest list, checking each entry against the others. With
+    // no list terms at all, every record is a candidate: records aren't in
+    // cycle order across harts, so a cycle range can't be bisected.
+    uint64_t matches = 0;
+    qsort(terms, numTerms, sizeof(terms[0]), compare_terms);
+    uint64_t candidates = (numTerms > 0) ? terms[0].count : trace.count;
+    for (uint64_t c = 0; !err && c < candidates; c++) {
+        uint32_t idx = (numTerms > 0) ? terms[0].idx[c] : (uint32_t)c;
+        size_t t = 1;
+        for (; t < numTerms; t++) {
+            term_seek(&terms[t], idx);
+            if (terms[t].pos == terms[t].count || terms[t].idx[terms[t].pos] != idx) {
+                break;
+            }
+        }
+        if (t < numTerms) {
+            continue;
+        }
+        const RvTraceRecord* rec = &trace.records[idx];
+        if (rec->cycle < cycleFrom || rec->cycle >= cycleTo) {
+            continue;
+        }
+        matches++;
+        if (!countOnly) {
+            trace_print_record(stdout, ' ', idx, rec);
+        }
+    }
+    if (!err && countOnly) {
+        printf("%llu\n", (unsigned long long)matches);
+    }
+
+    trace_index_close(&index);
+    trace_map_close(&trace);
+    return err;
+}
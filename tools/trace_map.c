@@ -0,0 +1,209 @@
+//  SPDX-FileCopyrightText: 2022 Jake Merdich <jake@merdich.com>
+//  SPDX-License-Identifier: Unlicense
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "trace_map.h"
+
+// Maps a whole file read-only. Returns NULL (having said why) on failure.
+static void* map_file(const char* path, size_t minSize, size_t* size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror(path);
+        close(fd);
+        return NULL;
+    }
+    if ((size_t)st.st_size < minSize) {
+        fprintf(stderr, "%s: too short\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    void* mapping = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        perror(path);
+        return NULL;
+    }
+    *size = (size_t)st.st_size;
+    return mapping;
+}
+
+int trace_map_open(const char* path, TraceMap* map) {
+    map->records = NULL;
+    map->count = 0;
+    map->mapping = NULL;
+    map->mappingSize = 0;
+
+    size_t size = 0;
+    void* mapping = map_file(path, sizeof(RvTraceHeader), &size);
+    if (mapping == NULL) {
+        return -1;
+    }
+    madvise(mapping, size, MADV_SEQUENTIAL);
+
+    const RvTraceHeader* hdr = (const RvTraceHeader*)mapping;
+    if (hdr->magic != RV_TRACE_MAGIC || hdr->version != RV_TRACE_VERSION ||
+        hdr->recordSize != sizeof(RvTraceRecord)) {
+        fprintf(stderr, "%s: not a version %d raw trace\n", path, RV_TRACE_VERSION);
+        munmap(mapping, size);
+        return -1;
+    }
+
+    map->records = (const RvTraceRecord*)(hdr + 1);
+    map->count = (size - sizeof(RvTraceHeader)) / sizeof(RvTraceRecord);
+    map->mapping = mapping;
+    map->mappingSize = size;
+    return 0;
+}
+
+void trace_map_close(TraceMap* map) {
+    if (map->mapping != NULL) {
+        munmap(map->mapping, map->mappingSize);
+    }
+    map->records = NULL;
+    map->count = 0;
+    map->mapping = NULL;
+    map->mappingSize = 0;
+}
+
+// Records checked per block before looking for the exact mismatch.
+#define CMP_BLOCK 64
+
+static uint64_t load64(const void* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+size_t trace_first_mismatch(const RvTraceRecord* a, const RvTraceRecord* b, size_t n) {
+    size_t i = 0;
+    // Whole blocks with no early exit so the compiler can vectorize the XORs;
+    // only a block that differs gets walked record by record.
+    for (; i + CMP_BLOCK <= n; i += CMP_BLOCK) {
+        uint64_t diff = 0;
+        for (size_t j = i; j < i + CMP_BLOCK; j++) {
+            diff |= (a[j].pc ^ b[j].pc) |
+                    (a[j].rdValue ^ b[j].rdValue) |
+                    (load64(&a[j].inst) ^ load64(&b[j].inst));
+        }
+        if (diff != 0) {
+            break;
+        }
+    }
+    for (; i < n; i++) {
+        if (memcmp(&a[i], &b[i], RV_TRACE_COMPARED_BYTES) != 0) {
+            return i;
+        }
+    }
+    return n;
+}
+
+void trace_print_record(FILE* out, char marker, size_t idx, const RvTraceRecord* rec) {
+    // Library owns the string (SimDoesCopy) until the next rv_disass call.
+    const char* disass = rv_disass(rec->inst);
+    fprintf(out, "%c %10zu  %016llx  %08x  %-32s",
+            marker, idx, (unsigned long long)rec->pc, rec->inst, disass);
+    if (rec->rd != 0) {
+        fprintf(out, "  %s=0x%llx", rv_reg_name(rec->rd), (unsigned long long)rec->rdValue);
+    }
+    fputc('\n', out);
+}
+
+const char* trace_parse_number(const char* text, unsigned long long max, unsigned long long* value) {
+    // strtoull takes leading spaces and signs too, and "-1" comes back huge.
+    if (*text < '0' || *text > '9') {
+        return NULL;
+    }
+    char* end = NULL;
+    errno = 0;
+    *value = strtoull(text, &end, 0);
+    if (errno == ERANGE || *value > max) {
+        return NULL;
+    }
+    return end;
+}
+
+int trace_index_open(const char* path, TraceIndex* index) {
+    memset(index, 0, sizeof(*index));
+
+    size_t size = 0;
+    void* mapping = map_file(path, sizeof(TraceIndexHeader), &size);
+    if (mapping == NULL) {
+        return -1;
+    }
+
+    const TraceIndexHeader* hdr = (const TraceIndexHeader*)mapping;
+    size_t listsEnd = sizeof(*hdr) + hdr->numLists * sizeof(TraceIndexList);
+    if (hdr->magic != RV_INDEX_MAGIC || hdr->version != RV_INDEX_VERSION || hdr->numLists > size ||
+        listsEnd > size) {
+        fprintf(stderr, "%s: not a version %d trace index\n", path, RV_INDEX_VERSION);
+        munmap(mapping, size);
+        return -1;
+    }
+    const TraceIndexList* lists = (const TraceIndexList*)(hdr + 1);
+    const uint32_t* postings = (const uint32_t*)((const char*)mapping + listsEnd);
+    uint64_t numPostings = (size - listsEnd) / sizeof(uint32_t);
+    for (uint64_t i = 0; i < hdr->numLists; i++) {
+        if (lists[i].offset > numPostings || lists[i].count > numPostings - lists[i].offset) {
+            fprintf(stderr, "%s: truncated trace index\n", path);
+            munmap(mapping, size);
+            return -1;
+        }
+        // Queries index the trace with these and gallop through them, so they
+        // have to be in range and strictly ascending.
+        const uint32_t* idx = postings + lists[i].offset;
+        for (uint64_t j = 0; j < lists[i].count; j++) {
+            if (idx[j] >= hdr->traceRecords || (j > 0 && idx[j] <= idx[j - 1])) {
+                fprintf(stderr, "%s: corrupt posting list\n", path);
+                munmap(mapping, size);
+                return -1;
+            }
+        }
+    }
+
+    index->hdr = hdr;
+    index->lists = lists;
+    index->postings = postings;
+    index->mapping = mapping;
+    index->mappingSize = size;
+    return 0;
+}
+
+void trace_index_close(TraceIndex* index) {
+    if (index->mapping != NULL) {
+        munmap(index->mapping, index->mappingSize);
+    }
+    memset(index, 0, sizeof(*index));
+}
+
+const uint32_t* trace_index_find(const TraceIndex* index, uint32_t key, uint64_t* count) {
+    uint64_t lo = 0;
+    uint64_t hi = index->hdr->numLists;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (index->lists[mid].key < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == index->hdr->numLists || index->lists[lo].key != key) {
+        *count = 0;
+        return NULL;
+    }
+    *count = index->lists[lo].count;
+    return index->postings + index->lists[lo].offset;
+}
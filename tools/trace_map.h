@@ -0,0 +1,88 @@
+//  SPDX-FileCopyrightText: 2022 Jake Merdich <jake@merdich.com>
+//  SPDX-License-Identifier: Unlicense
+
+#ifndef RV_TRACE_MAP_H
+#define RV_TRACE_MAP_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "rv_disass.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A raw trace file mapped read-only, see RvTraceRecord.
+typedef struct {
+    const RvTraceRecord* records;
+    size_t               count;
+    void*                mapping;
+    size_t               mappingSize;
+} TraceMap;
+
+// Returns 0 on success, otherwise prints why to stderr and returns -1.
+int trace_map_open(const char* path, TraceMap* map);
+void trace_map_close(TraceMap* map);
+
+// Index of the first of n records whose architectural fields (the first
+// RV_TRACE_COMPARED_BYTES) differ, or n if none.
+size_t trace_first_mismatch(const RvTraceRecord* a, const RvTraceRecord* b, size_t n);
+
+// One line of human-readable trace: pc, raw word, disassembly, writeback.
+// Register names follow the library's options, like the disassembly.
+void trace_print_record(FILE* out, char marker, size_t idx, const RvTraceRecord* rec);
+
+// Parses an unsigned number (decimal, 0x hex or 0 octal) of at most max from
+// the start of text. Returns where it stopped, or NULL if there's no number
+// there, or it's negative or too big.
+const char* trace_parse_number(const char* text, unsigned long long max, unsigned long long* value);
+
+// Inverted index over a raw trace, written by rv-traceindex. The file is a
+// TraceIndexHeader, numLists TraceIndexLists sorted by key, then the posting
+// lists themselves: ascending uint32 record indices.
+#define RV_INDEX_MAGIC   0x58495652 // "RVIX"
+#define RV_INDEX_VERSION 1
+
+enum {
+    IndexKey_Op = 1, // Opcode ID
+    IndexKey_Rd,     // Destination register
+    IndexKey_Rs,     // Either source register
+    IndexKey_Csr,    // CSR number
+};
+#define INDEX_KEY(kind, value) (((uint32_t)(kind) << 16) | (uint32_t)(value))
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint64_t traceRecords; // Must match the trace it's queried with
+    uint64_t numLists;
+} TraceIndexHeader;
+
+typedef struct {
+    uint32_t key;
+    uint32_t reserved;
+    uint64_t offset; // In records, from the start of the posting lists
+    uint64_t count;
+} TraceIndexList;
+
+typedef struct {
+    const TraceIndexHeader* hdr;
+    const TraceIndexList*   lists;
+    const uint32_t*         postings;
+    void*                   mapping;
+    size_t                  mappingSize;
+} TraceIndex;
+
+// Returns 0 on success, otherwise prints why to stderr and returns -1.
+int trace_index_open(const char* path, TraceIndex* index);
+void trace_index_close(TraceIndex* index);
+// Record indices for key, ascending; NULL with *count = 0 if it never occurs.
+const uint32_t* trace_index_find(const TraceIndex* index, uint32_t key, uint64_t* count);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif